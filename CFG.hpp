@@ -20,15 +20,161 @@ bool isUpper(string &s){
 	return true;
 }
 
+// Fixed size bitset over dense grammar symbol ids
+struct SymbolSet {
+	vector<uint64_t> words;
+
+	SymbolSet(size_t n = 0) : words((n + 63) / 64, 0) {}
+
+	bool test(int i) const {
+	    return (words[i >> 6] >> (i & 63)) & 1;
+	}
+
+	void set(int i) {
+	    words[i >> 6] |= uint64_t(1) << (i & 63);
+	}
+
+	// this |= other, returns true if any bit was added
+	bool unionWith(const SymbolSet &other) {
+	    uint64_t added = 0;
+	    for (size_t w = 0; w < words.size(); ++w) {
+	        uint64_t merged = words[w] | other.words[w];
+	        added |= merged ^ words[w];
+	        words[w] = merged;
+	    }
+	    return added != 0;
+	}
+
+	bool empty() const {
+	    for (uint64_t w : words) if (w) return false;
+	    return true;
+	}
+
+	bool operator==(const SymbolSet &other) const {
+	    return words == other.words;
+	}
+
+	// calls f(id) for every set bit in increasing order
+	template <typename F>
+	void forEach(F f) const {
+	    for (size_t w = 0; w < words.size(); ++w) {
+	        for (uint64_t bits = words[w]; bits; bits &= bits - 1) {
+	            f((int)(w * 64 + __builtin_ctzll(bits)));
+	        }
+	    }
+	}
+};
+
+// Nullable, FIRST and FOLLOW of every symbol id, computed once by CFG::analyze
+struct GrammarAnalysis {
+	vector<char> nullable;
+	vector<SymbolSet> first;       // FIRST(t) = {t} for terminals
+	vector<SymbolSet> follow;
+	bool firstDone = false;
+	bool followDone = false;
+};
+
+// Solves set[v] |= set[u] for every edge u -> v in succ, starting from the
+// initial sets. Strongly connected components are collapsed first (all their
+// members end up with the same set), then the condensation is swept once in
+// topological order, so the cost is linear in nodes + edges.
+void solveInclusions(vector<SymbolSet> &sets, const vector<vector<int> > &succ) {
+    int n = sets.size();
+    vector<int> index(n, -1), low(n, 0), comp(n, -1);
+    vector<char> onStack(n, 0);
+    vector<int> stack, order;   // order: components as Tarjan finishes them, sinks first
+    int counter = 0, numComps = 0;
+
+    // iterative Tarjan, frames hold (node, next successor to look at)
+    vector<pair<int, size_t> > frames;
+    for (int root = 0; root < n; ++root) {
+        if (index[root] >= 0) continue;
+        frames.push_back({root, 0});
+        index[root] = low[root] = counter++;
+        stack.push_back(root);
+        onStack[root] = 1;
+        while (!frames.empty()) {
+            int u = frames.back().first;
+            size_t &k = frames.back().second;
+            if (k < succ[u].size()) {
+                int v = succ[u][k++];
+                if (index[v] < 0) {
+                    index[v] = low[v] = counter++;
+                    stack.push_back(v);
+                    onStack[v] = 1;
+                    frames.push_back({v, 0});
+                } else if (onStack[v]) {
+                    low[u] = min(low[u], index[v]);
+                }
+                continue;
+            }
+            if (low[u] == index[u]) {
+                while (true) {
+                    int w = stack.back();
+                    stack.pop_back();
+                    onStack[w] = 0;
+                    comp[w] = numComps;
+                    if (w == u) break;
+                }
+                order.push_back(numComps++);
+            }
+            frames.pop_back();
+            if (!frames.empty()) {
+                int parent = frames.back().first;
+                low[parent] = min(low[parent], low[u]);
+            }
+        }
+    }
+
+    vector<vector<int> > members(numComps);
+    for (int u = 0; u < n; ++u) members[comp[u]].push_back(u);
+
+    vector<SymbolSet> compSet(numComps, SymbolSet(sets.empty() ? 0 : sets[0].words.size() * 64));
+    for (int u = 0; u < n; ++u) compSet[comp[u]].unionWith(sets[u]);
+
+    // sources first: every component is final before it is pushed forward
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        int c = *it;
+        for (int u : members[c]) {
+            for (int v : succ[u]) {
+                if (comp[v] != c) compSet[comp[v]].unionWith(compSet[c]);
+            }
+        }
+    }
+    for (int u = 0; u < n; ++u) sets[u] = compSet[comp[u]];
+}
+
+
 struct CFG{
 	string srcFile;
 	set<string> terminals;
 	set<string> nonTerminals;
 	vector<pair<string, vector<string> > > production;
+	// string keyed view of the FIRST/FOLLOW sets, filled from the bitsets below
 	unordered_map<string, set<string> > first, follow;
 
+	// Grammar interned into dense ids: terminals take [0, numTerminals) with
+	// the end marker $ as 0, nonterminals follow. EPSILON gets no id, an
+	// EPSILON production is simply an empty one.
+	vector<string> symbolNames;
+	unordered_map<string, int> symbolIds;
+	int numTerminals = 0;
+	int numSymbols = 0;
+	int endMarker = 0;
+	int startSymbol = -1;           // S'
+
+	// production p is prodLhs[p] -> rhsSymbols[prodStart[p] .. prodStart[p+1])
+	vector<int> prodLhs;
+	vector<int> prodStart;
+	vector<int> rhsSymbols;
+	vector<vector<int> > prodsByLhs; // indexed by nonterminal id - numTerminals
+
+	// FIRST/FOLLOW as bitsets over terminal ids, indexed by symbol id
+	GrammarAnalysis analysis;
+
 
 	CFG(string fileName){
+		PhaseScope phase("read grammar");
 		srcFile = fileName;
 		ifstream fptr(srcFile);
 		string line;
@@ -72,6 +218,54 @@ struct CFG{
 	
 		// Initialize FOLLOW set of augmented start symbol with $
 		follow["S'"].insert("$");
+
+		internSymbols();
+	}
+
+	void internSymbols() {
+	    symbolNames.push_back("$");
+	    for (const string &t : terminals) {
+	        if (t != "EPSILON") symbolNames.push_back(t);
+	    }
+	    numTerminals = symbolNames.size();
+	    for (const string &nt : nonTerminals) symbolNames.push_back(nt);
+	    numSymbols = symbolNames.size();
+	    for (int id = 0; id < numSymbols; ++id) symbolIds[symbolNames[id]] = id;
+	    startSymbol = symbolIds["S'"];
+
+	    prodsByLhs.assign(numSymbols - numTerminals, {});
+	    for (size_t p = 0; p < production.size(); ++p) {
+	        int lhs = symbolIds[production[p].first];
+	        prodLhs.push_back(lhs);
+	        prodStart.push_back(rhsSymbols.size());
+	        for (const string &sym : production[p].second) {
+	            if (sym != "EPSILON") rhsSymbols.push_back(symbolIds[sym]);
+	        }
+	        prodsByLhs[lhs - numTerminals].push_back(p);
+	    }
+	    prodStart.push_back(rhsSymbols.size());
+
+	}
+
+	int symbolId(const string &s) const {
+	    auto it = symbolIds.find(s);
+	    return it == symbolIds.end() ? -1 : it->second;
+	}
+
+	bool isTerminalId(int id) const {
+	    return id < numTerminals;
+	}
+
+	int numProductions() const {
+	    return prodLhs.size();
+	}
+
+	int rhsLength(int p) const {
+	    return prodStart[p + 1] - prodStart[p];
+	}
+
+	const int* rhsBegin(int p) const {
+	    return rhsSymbols.data() + prodStart[p];
 	}
 
 	bool isTerminal(const string &s){
@@ -84,110 +278,122 @@ struct CFG{
 		return false;
 	}
 
+	// nullable and FIRST, both by worklist
 	void computeAllFirsts() {
-	    for (const string &nt : nonTerminals) {
-	        findFirst(nt);
-	    }
-	}
-
-	void computeAllFollows() {
-	    for (const string &nt : nonTerminals) {
-	        findFollow(nt);
-	    }
-	}
+	    PhaseScope phase("FIRST");
+	    GrammarAnalysis &an = analysis;
+	    int numNT = numSymbols - numTerminals;
+	    an.nullable.assign(numSymbols, 0);
+	    an.first.assign(numSymbols, SymbolSet(numTerminals));
+	    for (int t = 0; t < numTerminals; ++t) an.first[t].set(t);
 
-	void findFirst(const string &s) {
-	    if (first.find(s) != first.end()) return;
-	
-	    for (auto &p : production) {
-	        if (p.first != s) continue;
-	
-	        const vector<string> &rhs = p.second;
-	
-	        // Case 1: EPSILON production
-	        if (rhs.size() == 1 && rhs.front() == "EPSILON") {
-	            first[s].insert("EPSILON");
-	            continue;
+	    // nullable: a production fires once all its rhs symbols are nullable
+	    vector<int> remaining(numProductions());
+	    vector<vector<int> > occurrences(numNT);   // productions using a nonterminal, once per use
+	    vector<int> work;
+	    for (int p = 0; p < numProductions(); ++p) {
+	        remaining[p] = rhsLength(p);
+	        const int *rhs = rhsBegin(p);
+	        for (int i = 0; i < rhsLength(p); ++i) {
+	            if (!isTerminalId(rhs[i])) occurrences[rhs[i] - numTerminals].push_back(p);
 	        }
-	
-	        // Case 2: Go through each symbol in RHS
-	        bool allNullable = true;
-	
-	        for (size_t i = 0; i < rhs.size(); ++i) {
-	            string symbol = rhs[i];
-	
-	            if (isTerminal(symbol)) {
-	                first[s].insert(symbol);
-	                allNullable = false;
-	                break;
-	            }
-	
-	            // Recursively find FIRST for non-terminal
-	            findFirst(symbol);
-	
-	            // Add FIRST(symbol) - EPSILON to FIRST(s)
-	            for (const string &f : first[symbol]) {
-	                if (f != "EPSILON") {
-	                    first[s].insert(f);
-	                }
+	        if (remaining[p] == 0 && !an.nullable[prodLhs[p]]) {
+	            an.nullable[prodLhs[p]] = 1;
+	            work.push_back(prodLhs[p]);
+	        }
+	    }
+	    while (!work.empty()) {
+	        int x = work.back();
+	        work.pop_back();
+	        for (int p : occurrences[x - numTerminals]) {
+	            if (--remaining[p] == 0 && !an.nullable[prodLhs[p]]) {
+	                an.nullable[prodLhs[p]] = 1;
+	                work.push_back(prodLhs[p]);
 	            }
-	
-	            // If EPSILON not in FIRST(symbol), stop
-	            if (first[symbol].find("EPSILON") == first[symbol].end()) {
-	                allNullable = false;
+	        }
+	    }
+
+	    // FIRST(A) contains the terminals leading its rhs and FIRST(X) for
+	    // every X reachable through a nullable prefix, an edge X -> A
+	    vector<SymbolSet> sets(numNT, SymbolSet(numTerminals));
+	    vector<vector<int> > succ(numNT);
+	    for (int p = 0; p < numProductions(); ++p) {
+	        int a = prodLhs[p] - numTerminals;
+	        const int *rhs = rhsBegin(p);
+	        for (int i = 0; i < rhsLength(p); ++i) {
+	            if (isTerminalId(rhs[i])) {
+	                sets[a].set(rhs[i]);
 	                break;
 	            }
+	            succ[rhs[i] - numTerminals].push_back(a);
+	            if (!an.nullable[rhs[i]]) break;
 	        }
-	
-	        // If all symbols in RHS could derive EPSILON, add EPSILON
-	        if (allNullable) {
-	            first[s].insert("EPSILON");
-	        }
+	    }
+	    solveInclusions(sets, succ);
+	    for (int a = 0; a < numNT; ++a) an.first[a + numTerminals] = sets[a];
+	    an.firstDone = true;
+
+	    first.clear();
+	    for (int nt = numTerminals; nt < numSymbols; ++nt) {
+	        if (prodsByLhs[nt - numTerminals].empty()) continue;
+	        first[symbolNames[nt]] = toNames(an.first[nt], an.nullable[nt]);
 	    }
 	}
-	void findFollow(const string &s) {
-	    if (follow.find(s) != follow.end() && !follow[s].empty()) return;
-	
-	    for (auto &p : production) {
-	        const string &lhs = p.first;
-	        const vector<string> &rhs = p.second;
-	
-	        for (int i = 0; i < rhs.size(); ++i) {
-	            if (rhs[i] != s) continue;
-	
-	            // Case: A → α B β
-	            if (i + 1 < rhs.size()) {
-	                string nextSymbol = rhs[i + 1];
-	
-	                // Case 1: next is terminal
-	                if (isTerminal(nextSymbol)) {
-	                    follow[s].insert(nextSymbol);
-	                }
-	                // Case 2: next is non-terminal
-	                else if (isNonTerminal(nextSymbol)) {
-	                    findFirst(nextSymbol);
-	                    for (const string &f : first[nextSymbol]) {
-	                        if (f != "EPSILON")
-	                            follow[s].insert(f);
-	                    }
-	
-	                    // If EPSILON is in FIRST(next), add FOLLOW(lhs)
-	                    if (first[nextSymbol].count("EPSILON")) {
-	                        findFollow(lhs);
-	                        follow[s].insert(follow[lhs].begin(), follow[lhs].end());
-	                    }
-	                }
+
+	void computeAllFollows() {
+	    if (!analysis.firstDone) computeAllFirsts();
+	    PhaseScope phase("FOLLOW");
+	    GrammarAnalysis &an = analysis;
+	    int numNT = numSymbols - numTerminals;
+
+	    // for A -> alpha B beta: FOLLOW(B) gets FIRST(beta), and FOLLOW(A)
+	    // through an edge A -> B when beta is nullable
+	    vector<SymbolSet> sets(numNT, SymbolSet(numTerminals));
+	    vector<vector<int> > succ(numNT);
+	    sets[startSymbol - numTerminals].set(endMarker);
+	    SymbolSet suffixFirst(numTerminals);
+	    for (int p = 0; p < numProductions(); ++p) {
+	        int a = prodLhs[p] - numTerminals;
+	        const int *rhs = rhsBegin(p);
+	        suffixFirst = SymbolSet(numTerminals);
+	        bool suffixNullable = true;
+	        for (int i = rhsLength(p) - 1; i >= 0; --i) {
+	            int sym = rhs[i];
+	            if (!isTerminalId(sym)) {
+	                sets[sym - numTerminals].unionWith(suffixFirst);
+	                if (suffixNullable && sym - numTerminals != a) succ[a].push_back(sym - numTerminals);
 	            }
-	            // Case: A → α B (B is at end)
-	            else {
-	                if (lhs != s) {
-	                    findFollow(lhs);
-	                    follow[s].insert(follow[lhs].begin(), follow[lhs].end());
-	                }
+	            if (an.nullable[sym]) {
+	                suffixFirst.unionWith(an.first[sym]);
+	            } else {
+	                suffixFirst = an.first[sym];
+	                suffixNullable = false;
 	            }
 	        }
 	    }
+	    solveInclusions(sets, succ);
+	    an.follow.assign(numSymbols, SymbolSet(numTerminals));
+	    for (int a = 0; a < numNT; ++a) an.follow[a + numTerminals] = sets[a];
+	    an.followDone = true;
+
+	    follow.clear();
+	    for (int nt = numTerminals; nt < numSymbols; ++nt) {
+	        follow[symbolNames[nt]] = toNames(an.follow[nt], false);
+	    }
+	}
+
+	// nullable, FIRST and FOLLOW, computed on first use
+	const GrammarAnalysis &analyze() {
+	    if (!analysis.firstDone) computeAllFirsts();
+	    if (!analysis.followDone) computeAllFollows();
+	    return analysis;
+	}
+
+	// names of the terminals in bits, plus EPSILON if requested
+	set<string> toNames(const SymbolSet &bits, bool withEpsilon) const {
+	    set<string> names;
+	    bits.forEach([&](int t) { names.insert(symbolNames[t]); });
+	    if (withEpsilon) names.insert("EPSILON");
+	    return names;
 	}
-	
-	
 };
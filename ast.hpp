@@ -0,0 +1,362 @@
+
+using namespace std;
+
+// Abstract syntax tree of a program, built by the parser's reduce actions.
+// Nodes are 16 bytes and sit in one array that only grows (a bump arena),
+// children are 32 bit indices into it, not pointers. Statements, elif/else
+// branches and list elements are chained through next, so a node never
+// needs more than two child fields. Freeing the tree is clear(), which keeps
+// the arena's memory for the next file.
+//
+//   BLOCK    a = first statement, b = count         (the program and every block)
+//   IF       a = first BRANCH, b = count
+//   BRANCH   a = condition, AST_NONE for else, b = BLOCK
+//   ASSIGN   a = NAME, b = value
+//   PRINT    a = argument
+//   INPUT    a = argument
+//   COMPARE  op = AST_LESS, AST_GREATER or AST_EQUAL, a and b the operands
+//   NAME     a = name id in Ast::names, b = source line (1 based) for error messages
+//   INT      the int64 value, low word in a, high word in b
+//   FLOAT    the double's bits, low word in a, high word in b
+//   STRING   a = offset into Ast::strings, b = length, escapes resolved
+//   BOOL     a = 0 or 1
+//   LIST     a = first element, b = count
+
+enum AstKind : uint8_t {
+    AST_BLOCK, AST_IF, AST_BRANCH, AST_ASSIGN, AST_PRINT, AST_INPUT, AST_COMPARE,
+    AST_NAME, AST_INT, AST_FLOAT, AST_STRING, AST_BOOL, AST_LIST,
+    AST_KIND_COUNT
+};
+
+const char *astKindNames[AST_KIND_COUNT] = {
+    "block", "if", "branch", "assign", "print", "input", "compare",
+    "name", "int", "float", "string", "bool", "list",
+};
+
+enum AstOp : uint8_t {
+    AST_NO_OP, AST_LESS, AST_GREATER, AST_EQUAL
+};
+
+const char *astOpNames[] = {"", "<", ">", "=="};
+
+const uint32_t AST_NONE = UINT32_MAX;
+
+struct AstNode {
+    AstKind kind;
+    AstOp op;
+    uint16_t unused = 0;
+    uint32_t next = AST_NONE;   // next statement, branch or list element
+    uint32_t a = AST_NONE, b = AST_NONE;
+};
+
+struct Ast {
+    vector<AstNode> nodes;
+    string strings;             // contents of the string literals
+    NameArena names;            // identifiers
+    uint32_t root = AST_NONE;   // the program's BLOCK once a parse was accepted
+
+    // nothing is freed node by node and the arrays keep their capacity
+    void clear() {
+        nodes.clear();
+        strings.clear();
+        names.clear();
+        root = AST_NONE;
+    }
+
+    uint32_t add(AstKind kind, uint32_t a = AST_NONE, uint32_t b = AST_NONE, AstOp op = AST_NO_OP) {
+        AstNode node;
+        node.kind = kind;
+        node.op = op;
+        node.a = a;
+        node.b = b;
+        nodes.push_back(node);
+        return nodes.size() - 1;
+    }
+
+    const AstNode &operator[](uint32_t n) const {
+        return nodes[n];
+    }
+
+    int64_t intValue(const AstNode &node) const {
+        return int64_t(uint64_t(node.a) | uint64_t(node.b) << 32);
+    }
+
+    double floatValue(const AstNode &node) const {
+        uint64_t bits = uint64_t(node.a) | uint64_t(node.b) << 32;
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    string_view stringValue(const AstNode &node) const {
+        return string_view(strings.data() + node.a, node.b);
+    }
+
+    // bytes in use: nodes, string contents and names
+    size_t bytes() const {
+        return nodes.size() * sizeof(AstNode) + strings.size() + names.chars.size() +
+               names.nameStart.size() * sizeof(uint32_t);
+    }
+
+    // node counts by kind, memory and memory per source line
+    void reportSize(size_t lines, ostream &out) const {
+        size_t count[AST_KIND_COUNT] = {};
+        for (const AstNode &node : nodes) count[node.kind]++;
+        out << "AST: " << nodes.size() << " nodes (";
+        for (int k = 0, shown = 0; k < AST_KIND_COUNT; ++k) {
+            if (count[k]) out << (shown++ ? ", " : "") << count[k] << " " << astKindNames[k];
+        }
+        out << "), " << bytes() << " bytes, " << (lines ? double(bytes()) / lines : 0.0) << " bytes/line over "
+            << lines << " lines, arena capacity " << nodes.capacity() * sizeof(AstNode) << " bytes" << endl;
+    }
+
+    void printValue(const AstNode &node, ostream &out) const {
+        switch (node.kind) {
+            case AST_NAME: out << " " << names.name(node.a); break;
+            case AST_INT: out << " " << intValue(node); break;
+            case AST_FLOAT: out << " " << floatValue(node); break;
+            case AST_STRING: out << " '" << stringValue(node) << "'"; break;
+            case AST_BOOL: out << (node.a ? " True" : " False"); break;
+            case AST_COMPARE: out << " " << astOpNames[node.op]; break;
+            default: break;
+        }
+    }
+
+    // indented dump of the subtree at n, depth first
+    void print(uint32_t n, ostream &out) const {
+        vector<pair<uint32_t, int> > todo = {{n, 0}};
+        while (!todo.empty()) {
+            uint32_t id = todo.back().first;
+            int depth = todo.back().second;
+            todo.pop_back();
+            if (id == AST_NONE) {
+                out << string(2 * depth, ' ') << "else\n";
+                continue;
+            }
+            const AstNode &node = nodes[id];
+            out << string(2 * depth, ' ') << astKindNames[node.kind];
+            printValue(node, out);
+            out << "\n";
+
+            // children pushed last first, so they come out in order
+            vector<uint32_t> children;
+            switch (node.kind) {
+                case AST_BLOCK: case AST_IF: case AST_LIST:
+                    for (uint32_t c = node.a; c != AST_NONE; c = nodes[c].next) children.push_back(c);
+                    break;
+                case AST_BRANCH: case AST_ASSIGN: case AST_COMPARE:
+                    children = {node.a, node.b};
+                    break;
+                case AST_PRINT: case AST_INPUT:
+                    children = {node.a};
+                    break;
+                default: break;
+            }
+            for (size_t i = children.size(); i-- > 0;) todo.push_back({children[i], depth + 1});
+        }
+    }
+};
+
+// Parser actions building an Ast. Every grammar symbol on the parser's stack
+// has a value here: a node, a chain of nodes or nothing. What a reduction
+// does is decided once per production from its lhs in grammar.txt, so the
+// reduce action is a switch, with no name lookups while parsing. Productions
+// of nonterminals it does not know pass their first value through. An
+// integer literal outside int64 sets error, which callers check after the
+// parse; the tree is then not to be used.
+template <class Tables>
+struct AstBuilder {
+    enum Rule : uint8_t {
+        R_PASS,         // value of the first child that has one
+        R_EMPTY,        // EPSILON
+        R_CHAIN,        // x rest → x prepended to the chain rest (stmt_list, elif_block, list_ele)
+        R_BLOCK,        // NEWLINE INDENT stmt stmt_list DEDENT
+        R_PROGRAM,
+        R_IF,
+        R_ELIF,
+        R_ELSE,
+        R_PRINT,
+        R_INPUT,
+        R_COMPARE,
+        R_ASSIGN,
+        R_LIST,
+    };
+
+    struct Value {
+        uint32_t node = AST_NONE;   // first node of a chain
+        uint32_t count = 0;         // chain length, the operator of a relop
+    };
+
+    const Tables &tables;
+    Lexer &lexer;
+    Ast ast;
+    vector<Value> stack;
+    vector<Rule> ruleOf;            // by production
+    vector<int8_t> leafOf;          // by terminal, the AstKind of its leaf, -1 for none
+    vector<uint8_t> opOf;           // by terminal, AstOp of the relational operators
+    string error;                   // the first literal the AST cannot hold, empty while there is none
+
+    AstBuilder(const Tables &tables, Lexer &lexer) : tables(tables), lexer(lexer) {
+        static const unordered_map<string, AstKind> leaves = {
+            {"IDENTIFIER", AST_NAME}, {"INTEGER", AST_INT}, {"FLOAT", AST_FLOAT},
+            {"STRING", AST_STRING}, {"BOOLEAN", AST_BOOL},
+        };
+        static const unordered_map<string, AstOp> ops = {
+            {"LESSTHAN", AST_LESS}, {"GREATERTHAN", AST_GREATER}, {"EQUALTO", AST_EQUAL},
+        };
+        for (int t = 0; t < tables.numTerminals; ++t) {
+            auto leaf = leaves.find(tables.symbolNames[t]);
+            auto op = ops.find(tables.symbolNames[t]);
+            leafOf.push_back(leaf != leaves.end() ? leaf->second : -1);
+            opOf.push_back(op != ops.end() ? op->second : AST_NO_OP);
+        }
+
+        static const unordered_map<string, Rule> rules = {
+            {"program", R_PROGRAM}, {"stmt_list", R_CHAIN}, {"elif_block", R_CHAIN}, {"list_ele", R_CHAIN},
+            {"block", R_BLOCK}, {"if_stmt", R_IF}, {"elif_clause", R_ELIF}, {"else_clause", R_ELSE},
+            {"print_stmt", R_PRINT}, {"input_stmt", R_INPUT}, {"expr", R_COMPARE}, {"assn_stmt", R_ASSIGN},
+            {"list", R_LIST},
+        };
+        for (size_t p = 0; p < productionCount(); ++p) {
+            auto rule = rules.find(tables.symbolNames[tables.prodLhs[p]]);
+            Rule r = rule != rules.end() ? rule->second : R_PASS;
+            if (tables.prodLength[p] == 0) r = r == R_PROGRAM ? R_PROGRAM : R_EMPTY;
+            ruleOf.push_back(r);
+        }
+    }
+
+    size_t productionCount() const {
+        if constexpr (is_same<Tables, ParseTables>::value) return tables.prodLhs.size();
+        else return sizeof(Tables::prodLhs) / sizeof(Tables::prodLhs[0]);
+    }
+
+    void clear() {
+        ast.clear();
+        stack.clear();
+        error.clear();
+    }
+
+    // string literal contents without the quotes, \n \t and \x for any other x resolved
+    uint32_t addString(string_view lexeme) {
+        uint32_t start = ast.strings.size();
+        for (size_t i = 1; i + 1 < lexeme.size(); ++i) {
+            char c = lexeme[i];
+            if (c == '\\' && i + 2 < lexeme.size()) {
+                c = lexeme[++i];
+                if (c == 'n') c = '\n';
+                else if (c == 't') c = '\t';
+            }
+            ast.strings += c;
+        }
+        return ast.add(AST_STRING, start, ast.strings.size() - start);
+    }
+
+    uint32_t addLeaf(AstKind kind, const Token &tok) {
+        string_view text = lexer.lexeme(tok);
+        uint64_t bits = 0;
+        switch (kind) {
+            case AST_NAME: {
+                int row, col;
+                lexer.position(tok, row, col);
+                return ast.add(AST_NAME, ast.names.intern(tok, lexer), row + 1);
+            }
+            case AST_STRING: return addString(text);
+            case AST_BOOL: return ast.add(AST_BOOL, text == "True");
+            case AST_INT: {
+                int64_t value;
+                if (from_chars(text.data(), text.data() + text.size(), value).ec == errc()) {
+                    bits = uint64_t(value);
+                } else if (error.empty()) {
+                    int row, col;
+                    lexer.position(tok, row, col);
+                    error = "Error at line " + to_string(row + 1) + ", column " + to_string(col + 1) +
+                            ": integer literal too large";
+                }
+                break;
+            }
+            case AST_FLOAT: {
+                double value = strtod(string(text).c_str(), nullptr);
+                memcpy(&bits, &value, sizeof(bits));
+                break;
+            }
+            default: break;
+        }
+        return ast.add(kind, uint32_t(bits), uint32_t(bits >> 32));
+    }
+
+    void shift(const Token &tok, int terminal) {
+        Value v;
+        if (leafOf[terminal] >= 0) {
+            v.node = addLeaf(AstKind(leafOf[terminal]), tok);
+            v.count = 1;
+        } else {
+            v.count = opOf[terminal];
+        }
+        stack.push_back(v);
+    }
+
+    void reduce(int prod, int length) {
+        Value *x = stack.data() + stack.size() - length;
+        Value v;
+        switch (ruleOf[prod]) {
+            case R_PASS:
+                for (int i = 0; i < length; ++i) {
+                    if (x[i].node != AST_NONE || x[i].count) {
+                        v = x[i];
+                        break;
+                    }
+                }
+                break;
+            case R_EMPTY:
+                break;
+            case R_CHAIN:
+                // element COMMA list_ele has the separator in between
+                v.node = x[0].node;
+                v.count = 1;
+                if (length > 1) {
+                    ast.nodes[v.node].next = x[length - 1].node;
+                    v.count += x[length - 1].count;
+                }
+                break;
+            case R_BLOCK:
+                ast.nodes[x[2].node].next = x[3].node;
+                v.node = ast.add(AST_BLOCK, x[2].node, 1 + x[3].count);
+                break;
+            case R_PROGRAM:
+                v.node = ast.root = ast.add(AST_BLOCK, length ? x[0].node : AST_NONE, length ? x[0].count : 0);
+                break;
+            case R_IF: {
+                // IF expr COLON block elif_block else_clause: the if branch, the elifs, the else
+                uint32_t first = ast.add(AST_BRANCH, x[1].node, x[3].node), last = first;
+                ast.nodes[first].next = x[4].node;
+                while (ast.nodes[last].next != AST_NONE) last = ast.nodes[last].next;
+                ast.nodes[last].next = x[5].node;
+                v.node = ast.add(AST_IF, first, 1 + x[4].count + (x[5].node != AST_NONE));
+                break;
+            }
+            case R_ELIF:
+                v.node = ast.add(AST_BRANCH, x[1].node, x[3].node);
+                break;
+            case R_ELSE:
+                v.node = ast.add(AST_BRANCH, AST_NONE, x[2].node);
+                break;
+            case R_PRINT:
+                v.node = ast.add(AST_PRINT, x[2].node);
+                break;
+            case R_INPUT:
+                v.node = ast.add(AST_INPUT, x[2].node);
+                break;
+            case R_COMPARE:
+                v.node = ast.add(AST_COMPARE, x[0].node, x[2].node, AstOp(x[1].count));
+                break;
+            case R_ASSIGN:
+                v.node = ast.add(AST_ASSIGN, x[0].node, x[2].node);
+                break;
+            case R_LIST:
+                v.node = ast.add(AST_LIST, x[1].node, x[1].count);
+                break;
+        }
+        stack.resize(stack.size() - length);
+        stack.push_back(v);
+    }
+};
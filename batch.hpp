@@ -0,0 +1,177 @@
+
+using namespace std;
+
+// Batch compilation: many source files in one process against one set of
+// parse tables. The tables (ParseTables or a generated parser's) and the
+// TerminalMap are built once and only read afterwards, so every worker
+// shares them. Each worker owns a Lexer, whose compiled DFA is reused from
+// file to file, a parser and an AST arena, and takes the next file off a
+// shared counter until none are left. Results are kept per file and
+// reported in input order, so the output does not depend on scheduling.
+// With run set every file that parses is also lowered to bytecode, after
+// the optimizer when optimize is set, and executed, as native code when jit
+// is set and the JIT can compile it, its output going to a file next to it
+// and its input() calls reading nothing.
+
+struct BatchOptions {
+    bool writeSymbolTables = true;
+    bool run = false;
+    bool optimize = false;
+    bool jit = false;
+};
+
+struct BatchFileResult {
+    string path;
+    bool ok = false;
+    string message;             // lexer or syntax error, empty when ok
+    size_t tokens = 0;
+    size_t identifiers = 0;     // symbols in the file's symbol table
+    size_t astNodes = 0;
+    size_t astBytes = 0;
+    uint64_t executed = 0;      // bytecode instructions, when run
+    bool native = false;        // run as native code
+    double seconds = 0;
+};
+
+// input files listed one per line, blank lines and # comments skipped
+bool readManifest(const string &path, vector<string> &files) {
+    ifstream in(path);
+    if (!in) return false;
+    string line;
+    while (getline(in, line)) {
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == string::npos || line[first] == '#') continue;
+        size_t last = line.find_last_not_of(" \t\r");
+        files.push_back(line.substr(first, last - first + 1));
+    }
+    return true;
+}
+
+// where the symbol table of an input file goes: next to it
+string batchSymbolTablePath(const string &path) {
+    return path + ".symboltable.txt";
+}
+
+// where a run's output goes
+string batchOutputPath(const string &path) {
+    return path + ".out";
+}
+
+// parser actions of one batch worker: the AST, plus the symbol table fed
+// every token as it is shifted
+template <class Tables>
+struct BatchActions {
+    AstBuilder<Tables> ast;
+    SymbolTable symbols;
+    Lexer &lexer;
+
+    BatchActions(const Tables &tables, Lexer &lexer) : ast(tables, lexer), lexer(lexer) {}
+
+    void clear() {
+        ast.clear();
+        symbols = SymbolTable();
+    }
+
+    void shift(const Token &tok, int terminal) {
+        symbols.add(tok, lexer);
+        ast.shift(tok, terminal);
+    }
+
+    void reduce(int prod, int length) {
+        ast.reduce(prod, length);
+    }
+};
+
+// runs a parsed file's AST, false with message set when it could not be run to the end
+bool runBatchFile(Ast &ast, BytecodeModule &module, const string &path, const BatchOptions &options,
+                  BatchFileResult &result) {
+    string &message = result.message;
+    if (options.optimize) {
+        OptimizerStats optimizerStats;
+        optimizeAst(ast, optimizerStats);
+    }
+    if (!compileToBytecode(ast, module, message)) return false;
+    ofstream out(batchOutputPath(path), ios::binary | ios::trunc);
+    if (!out) {
+        message = "Could not write " + batchOutputPath(path);
+        return false;
+    }
+    istringstream noInput;
+    Interpreter interpreter(module, noInput, out);
+    string why;
+    result.native = options.jit && interpreter.compileNative(why);
+    bool ok = interpreter.run();
+    result.executed = interpreter.executed;
+    if (!ok) message = interpreter.error;
+    return ok;
+}
+
+// lexes, parses and writes the symbol table of every file, on pool
+template <class Tables>
+vector<BatchFileResult> compileBatch(const Tables &tables, const vector<string> &files, ThreadPool &pool,
+                                     const BatchOptions &options = BatchOptions()) {
+    const TerminalMap terminalMap = TerminalMap::defaults(tables);
+    vector<BatchFileResult> results(files.size());
+    atomic<size_t> nextFile(0);
+
+    size_t workers = min(pool.size(), files.size());
+    pool.parallelFor(workers, [&](size_t) {
+        Lexer lexer("", LEXER_MMAP);
+        BasicLRParser<Tables> parser(tables, terminalMap);
+        BatchActions<Tables> actions(tables, lexer);
+        BytecodeModule module;
+        for (size_t i; (i = nextFile++) < files.size();) {
+            PhaseScope phase("compile file", files[i]);
+            BatchFileResult &result = results[i];
+            result.path = files[i];
+            auto start = chrono::steady_clock::now();
+            actions.clear();
+            parser.tokensParsed = 0;
+            if (!lexer.open(files[i])) {
+                result.message = lexer.error;
+            } else if (!parser.parse(lexer, actions)) {
+                // as for a single file, a lexical error anywhere in the file
+                // is reported over a syntax error before it
+                Token tok;
+                while (lexer.next(tok)) {}
+                result.message = lexer.failed() ? lexer.error : parser.error.toString();
+            } else if (!actions.ast.error.empty()) {
+                result.message = actions.ast.error;
+            } else {
+                actions.symbols.finish();
+                if (options.writeSymbolTables && !actions.symbols.writeToFile(batchSymbolTablePath(files[i]))) {
+                    result.message = "Could not write " + batchSymbolTablePath(files[i]);
+                } else {
+                    result.ok = !options.run || runBatchFile(actions.ast.ast, module, files[i], options, result);
+                }
+            }
+            result.tokens = parser.tokensParsed;
+            result.identifiers = actions.symbols.size();
+            result.astNodes = actions.ast.ast.nodes.size();
+            result.astBytes = actions.ast.ast.bytes();
+            result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        }
+    });
+    return results;
+}
+
+// one line per file, then the totals; returns the number of files that failed
+size_t reportBatch(const vector<BatchFileResult> &results, double seconds, size_t threads, ostream &out) {
+    size_t failed = 0, tokens = 0;
+    for (const BatchFileResult &r : results) {
+        out << r.path << ": ";
+        if (r.ok) {
+            out << "ok, " << r.tokens << " tokens, " << r.identifiers << " identifiers, " << r.astNodes
+                << " AST nodes (" << r.astBytes << " bytes)";
+            if (r.executed) out << ", " << r.executed << " instructions run" << (r.native ? " natively" : "");
+            out << "\n";
+        }
+        else out << r.message << "\n";
+        failed += !r.ok;
+        tokens += r.tokens;
+    }
+    out << "batch: " << results.size() << " files, " << results.size() - failed << " ok, " << failed << " failed, "
+        << tokens << " tokens in " << seconds * 1000 << " ms on " << threads << " threads ("
+        << (seconds > 0 ? results.size() / seconds : 0) << " files/s)\n";
+    return failed;
+}
@@ -0,0 +1,563 @@
+#include <bits/stdc++.h>
+
+#include "tokenDFA.hpp"
+#include "scanKernels.hpp"
+#include "threadPool.hpp"
+#include "stats.hpp"
+#include "lexer.hpp"
+#include "symbolTable.hpp"
+#include "tokenPipeline.hpp"
+#include "CFG.hpp"
+#include "parser.hpp"
+#include "lalr.hpp"
+#include "lrTable.hpp"
+#include "lrParser.hpp"
+#include "ast.hpp"
+#include "bytecode.hpp"
+#include "jit.hpp"
+#include "interpreter.hpp"
+#include "optimizer.hpp"
+
+// Benchmarks of the hot paths on synthetic inputs, results as one JSON object.
+//
+//   bench [--bytes N] [--depth D] [--levels L,L,...] [--statements K]
+//         [--repeat R] [--seed S] [--dir DIR] [--out FILE]
+//
+// A Python like source of about N bytes (if/elif/else nested up to D deep,
+// long nested lists, many identifiers) is lexed and parsed with grammar.txt,
+// one thread after the other and pipelined through a TokenPipeline,
+// and a runnable one of the same size is lowered to bytecode and run, as it
+// is and optimized, by the interpreter and as native code, whose output and
+// instruction count must match the interpreter's.
+// grammar.txt and generated expression grammars with L precedence levels and
+// K statement kinds are put through FIRST/FOLLOW, canonical LR(1), LALR(1)
+// and table construction. Times are the best of R runs, the generated files
+// go to DIR. Every run with the same arguments produces the same inputs, so
+// the JSON of two versions can be compared field by field.
+
+static const int BENCH_FORMAT_VERSION = 1;
+
+// Python like source accepted by grammar.txt. A runnable source assigns
+// every identifier first and only tests ==, so it runs to the end without
+// a NameError or TypeError, and prints instead of reading input.
+struct SourceGenerator {
+	mt19937 rng;
+	int maxDepth;
+	int numIdentifiers;
+	int maxListLength;
+	bool runnable = false;
+	string out;
+
+	SourceGenerator(unsigned seed, int maxDepth, int numIdentifiers, int maxListLength)
+		: rng(seed), maxDepth(maxDepth), numIdentifiers(numIdentifiers), maxListLength(maxListLength) {}
+
+	int pick(int n) {
+		return rng() % n;
+	}
+
+	void identifier() {
+		out += "v" + to_string(pick(numIdentifiers));
+	}
+
+	void literal() {
+		switch (pick(4)) {
+		case 0: out += to_string(pick(100000)); break;
+		case 1: out += to_string(pick(1000)) + "." + to_string(pick(100)); break;
+		case 2: out += "'s" + to_string(pick(1000)) + "'"; break;
+		default: out += pick(2) ? "True" : "False"; break;
+		}
+	}
+
+	// nested lists get shorter the deeper they are
+	void list(int nesting) {
+		out += "[";
+		int length = pick(max(1, maxListLength >> (2 * nesting)) + 1);
+		for (int i = 0; i < length; ++i) {
+			if (i) out += ", ";
+			if (nesting < 3 && pick(8) == 0) list(nesting + 1);
+			else literal();
+		}
+		out += "]";
+	}
+
+	void expr() {
+		size_t start = out.size();
+		identifier();
+		string lhs = out.substr(start);
+		static const char *relops[] = {" == ", " < ", " > "};
+		out += relops[runnable ? 0 : pick(3)];
+		// a runnable source tests identifiers against themselves too, so branches are taken
+		if (runnable && pick(2)) out += lhs;
+		else if (pick(2)) identifier();
+		else literal();
+	}
+
+	void indent(int depth) {
+		out.append(4 * depth, ' ');
+	}
+
+	void block(int depth) {
+		out += " :\n";
+		int stmts = 1 + pick(3);
+		for (int i = 0; i < stmts; ++i) stmt(depth);
+	}
+
+	void stmt(int depth) {
+		// nests more often near the top so the deepest blocks are reached
+		if (depth < maxDepth && pick(5) < 2) {
+			indent(depth);
+			out += "if ";
+			expr();
+			block(depth + 1);
+			int elifs = pick(4);
+			for (int i = 0; i < elifs; ++i) {
+				indent(depth);
+				out += "elif ";
+				expr();
+				block(depth + 1);
+			}
+			if (pick(2)) {
+				indent(depth);
+				out += "else";
+				block(depth + 1);
+			}
+			return;
+		}
+		indent(depth);
+		switch (pick(6)) {
+		case 0: out += "print("; pick(2) ? identifier() : literal(); out += ")"; break;
+		case 1: out += runnable ? "print(" : "input("; pick(2) ? identifier() : literal(); out += ")"; break;
+		case 2: identifier(); out += " = "; list(0); break;
+		case 3: identifier(); out += " = "; identifier(); break;
+		default: identifier(); out += " = "; literal(); break;
+		}
+		out += "\n";
+	}
+
+	const string &generate(size_t bytes) {
+		out.clear();
+		for (int i = 0; runnable && i < numIdentifiers; ++i) {
+			out += "v" + to_string(i) + " = ";
+			literal();
+			out += "\n";
+		}
+		while (out.size() < bytes) stmt(0);
+		return out;
+	}
+};
+
+// Expression grammar scaled by precedence levels and statement kinds:
+//   e0 : e0 OP0 e1 | e1   ...   eN : LEFTPAREN e0 RIGHTPAREN | IDENTIFIER LEFTPAREN args RIGHTPAREN | ...
+// every level adds states to the LR(1) collection, and lookahead sets grow with
+// the operator count, so it stresses closure, GOTO and state deduplication.
+string generateGrammar(int levels, int statements) {
+	string g;
+	g += "program : stmt_list\n";
+	g += "stmt_list : stmt stmt_list\n";
+	g += "stmt_list : EPSILON\n";
+	g += "stmt : IDENTIFIER ASSIGN e0 NEWLINE\n";
+	g += "stmt : IF e0 COLON block else_clause\n";
+	for (int k = 0; k < statements; ++k) g += "stmt : KW" + to_string(k) + " e0 NEWLINE\n";
+	g += "block : NEWLINE INDENT stmt stmt_list DEDENT\n";
+	g += "else_clause : ELSE COLON block\n";
+	g += "else_clause : EPSILON\n";
+	for (int i = 0; i < levels; ++i) {
+		string e = "e" + to_string(i), next = "e" + to_string(i + 1);
+		g += e + " : " + e + " OP" + to_string(i) + " " + next + "\n";
+		g += e + " : " + next + "\n";
+	}
+	string atom = "e" + to_string(levels);
+	g += atom + " : LEFTPAREN e0 RIGHTPAREN\n";
+	g += atom + " : IDENTIFIER LEFTPAREN args RIGHTPAREN\n";
+	g += atom + " : IDENTIFIER\n";
+	g += atom + " : INTEGER\n";
+	g += "args : e0 COMMA args\n";
+	g += "args : e0\n";
+	g += "args : EPSILON\n";
+	return g;
+}
+
+// best wall time of repeat runs of f
+template <class F>
+double bestOf(int repeat, F f) {
+	double best = numeric_limits<double>::max();
+	for (int r = 0; r < repeat; ++r) {
+		auto start = chrono::steady_clock::now();
+		f();
+		best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+	}
+	return best;
+}
+
+bool writeFile(const string &path, const string &contents) {
+	ofstream out(path, ios::binary | ios::trunc);
+	out << contents;
+	return bool(out);
+}
+
+void benchLexer(const string &path, size_t bytes, int repeat, ThreadPool &pool, JsonWriter &json) {
+	Lexer lexer(path, LEXER_MMAP);
+	size_t tokens = 0;
+	double streaming = bestOf(repeat, [&] {
+		lexer.openSource();
+		tokens = 0;
+		Token tok;
+		while (lexer.next(tok)) tokens++;
+	});
+	double parallel = bestOf(repeat, [&] { lexer.runLexerParallel(pool); });
+
+	json.begin("lexer");
+	json.field("tokens", tokens);
+	json.field("seconds", streaming);
+	json.field("bytesPerSecond", bytes / streaming);
+	json.field("tokensPerSecond", tokens / streaming);
+	json.field("parallelThreads", pool.size());
+	json.field("parallelSeconds", parallel);
+	json.field("parallelBytesPerSecond", bytes / parallel);
+	json.field("parallelTokens", lexer.allTokens.size());
+	json.field("error", lexer.error);
+	json.field("maxRssKiB", maxRssKiB());
+	json.end();
+}
+
+void benchParser(const string &path, const ParseTables &tables, int repeat, JsonWriter &json) {
+	Lexer lexer(path, LEXER_MMAP);
+	TerminalMap terminalMap = TerminalMap::defaults(tables);
+	LRParser parser(tables, terminalMap);
+	ParseTree tree(tables);
+	bool ok = true;
+	double seconds = bestOf(repeat, [&] {
+		tree.clear();
+		lexer.openSource();
+		ok = parser.parse(lexer, tree);
+	});
+
+	json.begin("parser");
+	json.field("accepted", ok);
+	if (!ok) json.field("error", parser.error.toString());
+	json.field("tokens", parser.tokensParsed);
+	json.field("seconds", seconds);
+	json.field("tokensPerSecond", parser.tokensParsed / seconds);
+	json.field("treeNodes", tree.nodes.size());
+	json.field("maxRssKiB", maxRssKiB());
+	json.end();
+}
+
+// the tokens of a file with the symbol table fed on the way, as a
+// TokenPipeline does: lexed on the spot, or replayed from tokens to time the
+// parser alone
+struct SerialTokens {
+	Lexer &lexer;
+	const vector<Token> *replay = nullptr;
+	size_t pos = 0;
+	SymbolTable symbols;
+
+	explicit SerialTokens(Lexer &lexer, const vector<Token> *replay = nullptr) : lexer(lexer), replay(replay) {}
+
+	bool next(Token &tok) {
+		if (replay) {
+			if (pos == replay->size()) return false;
+			tok = (*replay)[pos++];
+		} else if (!lexer.next(tok)) {
+			return false;
+		}
+		symbols.add(tok, lexer);
+		return true;
+	}
+};
+
+// lexing and parsing into the AST one after the other on one thread, and
+// overlapped on two, which should take about as long as the slower of the two
+void benchPipeline(const string &path, const ParseTables &tables, int repeat, JsonWriter &json) {
+	Lexer lexer(path, LEXER_MMAP);
+	TerminalMap terminalMap = TerminalMap::defaults(tables);
+	LRParser parser(tables, terminalMap);
+	AstBuilder<ParseTables> builder(tables, lexer);
+	vector<Token> tokens;
+	double lexing = bestOf(repeat, [&] {
+		tokens.clear();
+		lexer.openSource();
+		Token tok;
+		while (lexer.next(tok)) tokens.push_back(tok);
+	});
+	bool ok = true;
+	double parsing = bestOf(repeat, [&] {
+		builder.clear();
+		SerialTokens replay(lexer, &tokens);
+		ok = ok && parser.parseTokens(lexer, replay, builder);
+	});
+	double serial = bestOf(repeat, [&] {
+		builder.clear();
+		lexer.openSource();
+		SerialTokens serialTokens(lexer);
+		ok = ok && parser.parseTokens(lexer, serialTokens, builder);
+	});
+	double pipelined = bestOf(repeat, [&] {
+		builder.clear();
+		TokenPipeline pipeline(lexer);
+		ok = ok && parser.parseTokens(lexer, pipeline, builder) && pipeline.finish();
+	});
+
+	json.begin("pipeline");
+	json.field("accepted", ok);
+	if (!ok) json.field("error", parser.error.toString());
+	json.field("tokens", tokens.size());
+	json.field("ringTokens", TokenPipeline::DEFAULT_CAPACITY);
+	json.field("lexSeconds", lexing);
+	json.field("parseSeconds", parsing);
+	json.field("serialSeconds", serial);
+	json.field("pipelinedSeconds", pipelined);
+	// 1 when the pipeline takes as long as the slower stage alone
+	json.field("pipelinedOverSlowest", pipelined / max(lexing, parsing));
+	json.end();
+}
+
+// parsing straight into the AST, and what the AST costs per source line
+void benchAst(const string &path, const ParseTables &tables, int repeat, JsonWriter &json) {
+	Lexer lexer(path, LEXER_MMAP);
+	TerminalMap terminalMap = TerminalMap::defaults(tables);
+	LRParser parser(tables, terminalMap);
+	AstBuilder<ParseTables> builder(tables, lexer);
+	bool ok = true;
+	double seconds = bestOf(repeat, [&] {
+		builder.clear();
+		lexer.openSource();
+		ok = parser.parse(lexer, builder) && builder.error.empty();
+	});
+
+	const Ast &ast = builder.ast;
+	json.begin("ast");
+	json.field("accepted", ok);
+	json.field("seconds", seconds);
+	json.field("tokensPerSecond", parser.tokensParsed / seconds);
+	json.field("nodes", ast.nodes.size());
+	json.field("bytes", ast.bytes());
+	json.field("lines", lexer.rowNum);
+	json.field("bytesPerLine", lexer.rowNum ? double(ast.bytes()) / lexer.rowNum : 0.0);
+	// freeing the tree does not depend on its size
+	Ast copy = ast;
+	auto start = chrono::steady_clock::now();
+	copy.clear();
+	json.field("clearSeconds", chrono::duration<double>(chrono::steady_clock::now() - start).count());
+	json.end();
+}
+
+// lowers ast to bytecode and runs it interpreted and native, output discarded
+// except for one run of each that is compared
+void benchRun(const char *name, const Ast &ast, int repeat, JsonWriter &json) {
+	BytecodeModule module;
+	string error;
+	bool ok = true;
+	double lowering = bestOf(repeat, [&] { ok = ok && compileToBytecode(ast, module, error); });
+	ostream discard(nullptr);
+	istringstream noInput;
+	Interpreter interpreter(module, noInput, discard);
+	double running = bestOf(repeat, [&] { ok = ok && interpreter.run(); });
+
+	ostringstream interpreted, native;
+	Interpreter reference(module, noInput, interpreted);
+	reference.run();
+	Interpreter jit(module, noInput, discard), checked(module, noInput, native);
+	string why;
+	double compiling = bestOf(repeat, [&] { jit.compileNative(why); });
+	bool nativeOk = jit.native.ready() && checked.compileNative(why);
+	double runningNative = nativeOk ? bestOf(repeat, [&] { nativeOk = nativeOk && jit.run(); }) : 0;
+	if (nativeOk) checked.run();
+	bool matches = nativeOk && native.str() == interpreted.str() && checked.error == reference.error &&
+	               checked.executed == reference.executed;
+
+	json.begin(name);
+	json.field("ok", ok);
+	if (!ok) json.field("error", error + interpreter.error);
+	json.field("instructions", module.code.size());
+	json.field("registers", module.numRegisters());
+	json.field("executed", interpreter.executed);
+	json.field("loweringSeconds", lowering);
+	json.field("runSeconds", running);
+	json.field("executedPerSecond", interpreter.executed / running);
+	json.field("native", nativeOk);
+	if (!nativeOk) json.field("nativeError", why + jit.error);
+	json.field("nativeMatches", matches);
+	json.field("nativeBytes", jit.native.codeBytes);
+	json.field("nativeCompileSeconds", compiling);
+	json.field("nativeRunSeconds", runningNative);
+	json.field("nativeSpeedup", runningNative > 0 ? running / runningNative : 0.0);
+	json.end();
+}
+
+// a runnable source run as it is and after the optimizer
+void benchInterpreter(const string &path, const ParseTables &tables, int repeat, JsonWriter &json) {
+	Lexer lexer(path, LEXER_MMAP);
+	TerminalMap terminalMap = TerminalMap::defaults(tables);
+	LRParser parser(tables, terminalMap);
+	AstBuilder<ParseTables> builder(tables, lexer);
+	lexer.openSource();
+	bool parsed = parser.parse(lexer, builder), ok = parsed && builder.error.empty();
+
+	json.begin("interpreter");
+	json.field("accepted", ok);
+	if (!ok) json.field("error", parsed ? builder.error : parser.error.toString());
+	benchRun("plain", builder.ast, repeat, json);
+
+	Ast optimized = builder.ast;
+	OptimizerStats optimizerStats;
+	optimizeAst(optimized, optimizerStats);
+	json.begin("optimizer");
+	json.field("statementsBefore", optimizerStats.statementsBefore);
+	json.field("statementsAfter", optimizerStats.statementsAfter);
+	json.field("propagated", optimizerStats.propagated);
+	json.field("folded", optimizerStats.folded);
+	json.field("armsRemoved", optimizerStats.armsRemoved);
+	json.field("ifsFlattened", optimizerStats.ifsFlattened);
+	json.field("deadStores", optimizerStats.deadStores);
+	json.field("forwardSeconds", optimizerStats.forwardSeconds);
+	json.field("backwardSeconds", optimizerStats.backwardSeconds);
+	json.end();
+	benchRun("optimized", optimized, repeat, json);
+	json.end();
+}
+
+size_t countGotos(const vector<DFA_State> &states) {
+	size_t gotos = 0;
+	for (const DFA_State &state : states) gotos += state.edges.size();
+	return gotos;
+}
+
+// FIRST/FOLLOW, both constructions and the tables of one grammar file,
+// tablesOut gets the canonical tables when given
+void benchGrammar(const string &name, const string &path, int repeat, JsonWriter &json,
+                  ParseTables *tablesOut = nullptr) {
+	CFG grammar(path);
+	double firstFollow = bestOf(repeat, [&] {
+		grammar.computeAllFirsts();
+		grammar.computeAllFollows();
+	});
+
+	json.begin();
+	json.field("name", name);
+	json.field("terminals", grammar.numTerminals);
+	json.field("nonTerminals", grammar.numSymbols - grammar.numTerminals);
+	json.field("productions", grammar.numProductions());
+	json.field("firstFollowSeconds", firstFollow);
+
+	for (LRMode mode : {LR_CANONICAL, LR_LALR}) {
+		vector<DFA_State> states;
+		unique_ptr<ClosureEngine> engine;
+		double build = bestOf(repeat, [&] {
+			engine.reset(new ClosureEngine(grammar));
+			LRBuildOptions options;
+			options.mode = mode;
+			options.engine = engine.get();
+			states = buildLRCollection(grammar, options);
+		});
+		ParseTables local;
+		ParseTables &tables = tablesOut && mode == LR_CANONICAL ? *tablesOut : local;
+		double tableBuild = bestOf(repeat, [&] { tables.build(states, grammar); });
+
+		json.begin(mode == LR_LALR ? "lalr" : "lr1");
+		json.field("states", states.size());
+		json.field("seconds", build);
+		json.field("closureCalls", engine->closureCalls);
+		json.field("itemsCreated", engine->itemsCreated);
+		json.field("gotos", countGotos(states));
+		json.field("tableSeconds", tableBuild);
+		json.field("tableBytes", tables.actions.bytes() + tables.gotos.bytes());
+		json.field("conflicts", tables.conflicts.size());
+		json.field("maxRssKiB", maxRssKiB());
+		json.end();
+	}
+	json.end();
+}
+
+int main(int argc, char **argv) {
+	size_t bytes = 1 << 20;
+	int depth = 6, statements = 8, repeat = 3;
+	unsigned seed = 1;
+	vector<int> levels = {2, 4, 8};
+	string dir = "bench_data", outPath;
+	for (int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--bytes" && hasValue) bytes = stoull(argv[++i]);
+		else if (arg == "--depth" && hasValue) depth = stoi(argv[++i]);
+		else if (arg == "--statements" && hasValue) statements = stoi(argv[++i]);
+		else if (arg == "--repeat" && hasValue) repeat = max(1, stoi(argv[++i]));
+		else if (arg == "--seed" && hasValue) seed = stoul(argv[++i]);
+		else if (arg == "--dir" && hasValue) dir = argv[++i];
+		else if (arg == "--out" && hasValue) outPath = argv[++i];
+		else if (arg == "--levels" && hasValue) {
+			levels.clear();
+			stringstream ss(argv[++i]);
+			string level;
+			while (getline(ss, level, ',')) levels.push_back(stoi(level));
+		} else {
+			cerr << "unknown argument " << arg << endl;
+			return 1;
+		}
+	}
+
+	mkdir(dir.c_str(), 0755);
+	string sourcePath = dir + "/source.py";
+	SourceGenerator generator(seed, depth, 4096, 64);
+	const string &source = generator.generate(bytes);
+	if (!writeFile(sourcePath, source)) {
+		cerr << "Error: Could not write " << sourcePath << endl;
+		return 1;
+	}
+
+	string scriptPath = dir + "/script.py";
+	SourceGenerator scriptGenerator(seed, depth, 4096, 64);
+	scriptGenerator.runnable = true;
+	if (!writeFile(scriptPath, scriptGenerator.generate(bytes))) {
+		cerr << "Error: Could not write " << scriptPath << endl;
+		return 1;
+	}
+
+	ofstream file;
+	if (!outPath.empty()) {
+		file.open(outPath);
+		if (!file) {
+			cerr << "Error: Could not open file " << outPath << " for writing." << endl;
+			return 1;
+		}
+	}
+	JsonWriter json(outPath.empty() ? cout : file);
+	ThreadPool pool;
+
+	json.begin();
+	json.field("formatVersion", BENCH_FORMAT_VERSION);
+	json.begin("config");
+	json.field("bytes", bytes);
+	json.field("depth", depth);
+	json.field("statements", statements);
+	json.field("repeat", repeat);
+	json.field("seed", seed);
+	json.end();
+	json.begin("source");
+	json.field("bytes", source.size());
+	json.field("lines", count(source.begin(), source.end(), '\n'));
+	json.end();
+
+	benchLexer(sourcePath, source.size(), repeat, pool, json);
+
+	ParseTables tables;
+	json.begin("grammars", '[');
+	benchGrammar("grammar.txt", "grammar.txt", repeat, json, &tables);
+	for (int level : levels) {
+		string path = dir + "/grammar_levels" + to_string(level) + ".txt";
+		if (!writeFile(path, generateGrammar(level, statements))) {
+			cerr << "Error: Could not write " << path << endl;
+			return 1;
+		}
+		benchGrammar("levels" + to_string(level), path, repeat, json);
+	}
+	json.end(']');
+
+	benchParser(sourcePath, tables, repeat, json);
+	benchAst(sourcePath, tables, repeat, json);
+	benchPipeline(sourcePath, tables, repeat, json);
+	benchInterpreter(scriptPath, tables, repeat, json);
+	json.field("maxRssKiB", maxRssKiB());
+	json.end();
+	return 0;
+}
@@ -0,0 +1,416 @@
+
+using namespace std;
+
+// Register bytecode for the AST of ast.hpp. Every variable the program
+// still uses is a register and every literal is a constant register after
+// them, loaded once when a program starts, so all operands are registers
+// and there is no load instruction. A comparison only ever decides an if, so
+// it is fused with the branch: UNLESS_LESS a, b, c jumps to c unless a < b.
+//
+//   MOVE a, b            a = b
+//   PRINT a              print(a)
+//   INPUT a              input(a), the line read is dropped
+//   UNLESS_LESS a, b, c  (and UNLESS_GREATER, UNLESS_EQUAL)
+//   JUMP c
+//   HALT
+//
+// Values are 16 byte tagged unions. Strings and lists are constants, as the
+// language has no operation that makes new ones, so they are a length plus
+// an offset into the module's string and list item arrays.
+
+enum ValueTag : uint8_t {
+    V_UNDEFINED, V_INT, V_FLOAT, V_BOOL, V_STRING, V_LIST
+};
+
+const char *valueTagNames[] = {"undefined", "int", "float", "bool", "str", "list"};
+
+struct Value {
+    ValueTag tag = V_UNDEFINED;
+    uint32_t length = 0;        // of a string or list
+    union {
+        int64_t i = 0;          // ints and bools
+        double f;
+        uint64_t start;         // of a string in strings, of a list in listItems
+    };
+};
+
+enum Opcode : uint8_t {
+    OP_MOVE, OP_PRINT, OP_INPUT, OP_UNLESS_LESS, OP_UNLESS_GREATER, OP_UNLESS_EQUAL, OP_JUMP, OP_HALT,
+    OP_COUNT
+};
+
+const char *opcodeNames[OP_COUNT] = {
+    "MOVE", "PRINT", "INPUT", "UNLESS_LESS", "UNLESS_GREATER", "UNLESS_EQUAL", "JUMP", "HALT",
+};
+
+// 12 bytes, registers are 24 bits in a and 32 in b
+struct Instruction {
+    uint32_t op : 8, a : 24;
+    uint32_t b, c;
+};
+
+const uint32_t MAX_REGISTERS = 1u << 24;
+
+// a float the way Python's repr writes it: shortest round trip digits,
+// positional for exponents -4 to 15 and always with a . or an exponent
+void appendFloat(string &out, double value) {
+    if (isnan(value)) {
+        out += "nan";
+        return;
+    }
+    if (isinf(value)) {
+        out += value < 0 ? "-inf" : "inf";
+        return;
+    }
+    char buf[32];
+    char *end = to_chars(buf, buf + sizeof(buf) - 1, value, chars_format::scientific).ptr;
+    *end = '\0';
+    char *e = find(buf, end, 'e');
+    int exponent = atoi(e + 1);
+    const char *p = buf;
+    if (*p == '-') out += *p++;
+    string digits;
+    for (; p < e; ++p) {
+        if (*p != '.') digits += *p;
+    }
+
+    if (exponent >= -4 && exponent < 16) {
+        if (exponent < 0) {
+            out += "0.";
+            out.append(-exponent - 1, '0');
+            out += digits;
+        } else {
+            size_t whole = exponent + 1;
+            if (digits.size() < whole) digits.append(whole - digits.size(), '0');
+            out.append(digits, 0, whole);
+            out += '.';
+            out += whole < digits.size() ? digits.substr(whole) : "0";
+        }
+        return;
+    }
+    out += digits[0];
+    if (digits.size() > 1) out += "." + digits.substr(1);
+    out += exponent < 0 ? "e-" : "e+";
+    if (abs(exponent) < 10) out += '0';
+    out += to_string(abs(exponent));
+}
+
+struct BytecodeModule {
+    vector<Instruction> code;
+    vector<uint32_t> lines;         // source line of each instruction, 0 if unknown
+    NameArena names;
+    vector<uint32_t> variableNames; // name id of every variable register
+    uint32_t numVariables = 0;
+    vector<Value> constants;        // register numVariables + k holds constants[k]
+    vector<Value> listItems;
+    string strings;
+
+    uint32_t numRegisters() const {
+        return numVariables + constants.size();
+    }
+
+    string_view variableName(uint32_t r) const {
+        return names.name(variableNames[r]);
+    }
+
+    string_view stringOf(const Value &v) const {
+        return string_view(strings.data() + v.start, v.length);
+    }
+
+    // str(v), or repr(v) for the items of a list
+    void appendValue(string &out, const Value &v, bool repr = false) const {
+        switch (v.tag) {
+            case V_INT: {
+                char buf[24];
+                out.append(buf, to_chars(buf, buf + sizeof(buf), v.i).ptr - buf);
+                break;
+            }
+            case V_FLOAT: appendFloat(out, v.f); break;
+            case V_BOOL: out += v.i ? "True" : "False"; break;
+            case V_STRING: {
+                string_view s = stringOf(v);
+                if (!repr) {
+                    out.append(s.data(), s.size());
+                    break;
+                }
+                char quote = s.find('\'') != string_view::npos && s.find('"') == string_view::npos ? '"' : '\'';
+                out += quote;
+                for (char c : s) {
+                    if (c == '\n') out += "\\n";
+                    else if (c == '\t') out += "\\t";
+                    else if (c == '\\' || c == quote) out += {'\\', c};
+                    else out += c;
+                }
+                out += quote;
+                break;
+            }
+            case V_LIST:
+                out += '[';
+                for (uint32_t k = 0; k < v.length; ++k) {
+                    if (k) out += ", ";
+                    appendValue(out, listItems[v.start + k], true);
+                }
+                out += ']';
+                break;
+            case V_UNDEFINED: out += "<undefined>"; break;
+        }
+    }
+
+    // the Value of an AST literal, its string or list items added to this module
+    Value literalValue(const Ast &ast, uint32_t n) {
+        const AstNode &node = ast[n];
+        Value v;
+        switch (node.kind) {
+            case AST_INT: v.tag = V_INT; v.i = ast.intValue(node); break;
+            case AST_FLOAT: v.tag = V_FLOAT; v.f = ast.floatValue(node); break;
+            case AST_BOOL: v.tag = V_BOOL; v.i = node.a; break;
+            case AST_STRING: {
+                string_view s = ast.stringValue(node);
+                v.tag = V_STRING;
+                v.start = strings.size();
+                v.length = s.size();
+                strings.append(s.data(), s.size());
+                break;
+            }
+            case AST_LIST: {
+                vector<Value> items;
+                for (uint32_t c = node.a; c != AST_NONE; c = ast[c].next) items.push_back(literalValue(ast, c));
+                v.tag = V_LIST;
+                v.start = listItems.size();
+                v.length = items.size();
+                listItems.insert(listItems.end(), items.begin(), items.end());
+                break;
+            }
+            default: break;
+        }
+        return v;
+    }
+
+    static bool isNumber(const Value &v) {
+        return v.tag == V_INT || v.tag == V_FLOAT || v.tag == V_BOOL;
+    }
+
+    static double number(const Value &v) {
+        return v.tag == V_FLOAT ? v.f : double(v.i);
+    }
+
+    // Python's ==: numbers by value, strings and lists by contents, other mixes unequal
+    bool equal(const Value &x, const Value &y) const {
+        if (isNumber(x) && isNumber(y)) {
+            return x.tag != V_FLOAT && y.tag != V_FLOAT ? x.i == y.i : number(x) == number(y);
+        }
+        if (x.tag != y.tag) return false;
+        if (x.tag == V_STRING) return stringOf(x) == stringOf(y);
+        if (x.length != y.length) return false;
+        for (uint32_t k = 0; k < x.length; ++k) {
+            if (!equal(listItems[x.start + k], listItems[y.start + k])) return false;
+        }
+        return true;
+    }
+
+    // x < y (less) or x > y, -1 with typeError set when Python raises a
+    // TypeError, op names the operator for it
+    int ordered(const Value &x, const Value &y, bool less, const char *op, string &typeError) const {
+        if (isNumber(x) && isNumber(y)) {
+            if (x.tag != V_FLOAT && y.tag != V_FLOAT) return less ? x.i < y.i : x.i > y.i;
+            return less ? number(x) < number(y) : number(x) > number(y);
+        }
+        if (x.tag == V_STRING && y.tag == V_STRING) {
+            int c = stringOf(x).compare(stringOf(y));
+            return less ? c < 0 : c > 0;
+        }
+        if (x.tag == V_LIST && y.tag == V_LIST) {
+            // the first items that differ decide, else the lengths
+            for (uint32_t k = 0; k < x.length && k < y.length; ++k) {
+                const Value &a = listItems[x.start + k], &b = listItems[y.start + k];
+                if (!equal(a, b)) return ordered(a, b, less, op, typeError);
+            }
+            return less ? x.length < y.length : x.length > y.length;
+        }
+        typeError = string("TypeError: '") + op + "' not supported between instances of '" +
+                    valueTagNames[x.tag] + "' and '" + valueTagNames[y.tag] + "'";
+        return -1;
+    }
+
+    // a variable by name, a constant by value
+    string operand(uint32_t r) const {
+        if (r < numVariables) return string(variableName(r));
+        string res;
+        appendValue(res, constants[r - numVariables], true);
+        return res;
+    }
+
+    void disassemble(ostream &out) const {
+        out << "bytecode: " << code.size() << " instructions, " << numVariables << " variables, "
+            << constants.size() << " constants\n";
+        for (size_t pc = 0; pc < code.size(); ++pc) {
+            const Instruction &ins = code[pc];
+            out << setw(6) << pc << "  " << left << setw(15) << opcodeNames[ins.op] << right;
+            switch (ins.op) {
+                case OP_MOVE: out << operand(ins.a) << ", " << operand(ins.b); break;
+                case OP_PRINT: case OP_INPUT: out << operand(ins.a); break;
+                case OP_UNLESS_LESS: case OP_UNLESS_GREATER: case OP_UNLESS_EQUAL:
+                    out << operand(ins.a) << ", " << operand(ins.b) << " -> " << ins.c;
+                    break;
+                case OP_JUMP: out << "-> " << ins.c; break;
+                default: break;
+            }
+            if (lines[pc]) out << "    ; line " << lines[pc];
+            out << "\n";
+        }
+    }
+};
+
+// Lowers an Ast into a BytecodeModule. Equal scalar literals share one
+// constant register, as does every use of one list literal node, and list
+// literals are laid out children first so the items of every list are
+// contiguous.
+class BytecodeCompiler {
+private:
+    const Ast &ast;
+    BytecodeModule &module;
+    map<pair<int, uint64_t>, uint32_t> scalarConstants;     // (tag, bits) → register
+    unordered_map<string, uint32_t> stringConstants;        // contents → register
+    unordered_map<uint32_t, uint32_t> listConstants;        // AST node → register
+    vector<uint32_t> registerOf;                            // by name id, NO_ENTRY if unused
+
+    void useVariable(uint32_t n) {
+        if (ast[n].kind != AST_NAME || registerOf[ast[n].a] != NO_ENTRY) return;
+        registerOf[ast[n].a] = module.variableNames.size();
+        module.variableNames.push_back(ast[n].a);
+    }
+
+    // numbers the variables a block uses in order of first use, so names
+    // the optimizer took every use of get no register
+    void collectVariables(uint32_t block) {
+        for (uint32_t s = ast[block].a; s != AST_NONE; s = ast[s].next) {
+            const AstNode &node = ast[s];
+            if (node.kind == AST_ASSIGN) {
+                useVariable(node.a);
+                useVariable(node.b);
+            } else if (node.kind == AST_PRINT || node.kind == AST_INPUT) {
+                useVariable(node.a);
+            } else if (node.kind == AST_IF) {
+                for (uint32_t br = node.a; br != AST_NONE; br = ast[br].next) {
+                    if (ast[br].a != AST_NONE) {
+                        useVariable(ast[ast[br].a].a);
+                        useVariable(ast[ast[br].a].b);
+                    }
+                    collectVariables(ast[br].b);
+                }
+            }
+        }
+    }
+
+    uint32_t emit(Opcode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint32_t line = 0) {
+        Instruction ins;
+        ins.op = op;
+        ins.a = a;
+        ins.b = b;
+        ins.c = c;
+        module.code.push_back(ins);
+        module.lines.push_back(line);
+        return module.code.size() - 1;
+    }
+
+    Value literal(uint32_t n) {
+        return module.literalValue(ast, n);
+    }
+
+    uint32_t addConstant(const Value &v) {
+        module.constants.push_back(v);
+        return module.numVariables + module.constants.size() - 1;
+    }
+
+    // the register holding a NAME or literal
+    uint32_t operand(uint32_t n) {
+        const AstNode &node = ast[n];
+        if (node.kind == AST_NAME) return registerOf[node.a];
+        if (node.kind == AST_STRING) {
+            auto found = stringConstants.find(string(ast.stringValue(node)));
+            if (found != stringConstants.end()) return found->second;
+            return stringConstants[string(ast.stringValue(node))] = addConstant(literal(n));
+        }
+        if (node.kind == AST_LIST) {
+            auto found = listConstants.find(n);
+            if (found != listConstants.end()) return found->second;
+            return listConstants[n] = addConstant(literal(n));
+        }
+        Value v = literal(n);
+        auto key = make_pair(int(v.tag), uint64_t(v.i));
+        auto found = scalarConstants.find(key);
+        if (found != scalarConstants.end()) return found->second;
+        return scalarConstants[key] = addConstant(v);
+    }
+
+    // line of a NAME operand, 0 for literals
+    uint32_t lineOf(uint32_t n) const {
+        return ast[n].kind == AST_NAME ? ast[n].b : 0;
+    }
+
+    void block(uint32_t n) {
+        for (uint32_t s = ast[n].a; s != AST_NONE; s = ast[s].next) statement(s);
+    }
+
+    void statement(uint32_t n) {
+        const AstNode &node = ast[n];
+        switch (node.kind) {
+            case AST_ASSIGN:
+                emit(OP_MOVE, operand(node.a), operand(node.b), 0, lineOf(node.a));
+                break;
+            case AST_PRINT:
+                emit(OP_PRINT, operand(node.a), 0, 0, lineOf(node.a));
+                break;
+            case AST_INPUT:
+                emit(OP_INPUT, operand(node.a), 0, 0, lineOf(node.a));
+                break;
+            case AST_IF: {
+                // each condition jumps to the next branch when false, each body to the end
+                vector<uint32_t> exits;
+                for (uint32_t br = node.a; br != AST_NONE; br = ast[br].next) {
+                    const AstNode &branch = ast[br];
+                    uint32_t test = AST_NONE;
+                    if (branch.a != AST_NONE) {
+                        const AstNode &cond = ast[branch.a];
+                        Opcode op = cond.op == AST_LESS ? OP_UNLESS_LESS
+                                  : cond.op == AST_GREATER ? OP_UNLESS_GREATER : OP_UNLESS_EQUAL;
+                        test = emit(op, operand(cond.a), operand(cond.b), 0, max(lineOf(cond.a), lineOf(cond.b)));
+                    }
+                    block(branch.b);
+                    if (test == AST_NONE) break;
+                    if (branch.next != AST_NONE) exits.push_back(emit(OP_JUMP));
+                    module.code[test].c = module.code.size();
+                }
+                for (uint32_t jump : exits) module.code[jump].c = module.code.size();
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+public:
+    BytecodeCompiler(const Ast &ast, BytecodeModule &module) : ast(ast), module(module) {}
+
+    // false with error set when the program needs more registers than an instruction can name
+    bool compile(string &error) {
+        PhaseScope phase("lower to bytecode");
+        module = BytecodeModule();
+        module.names = ast.names;
+        registerOf.assign(ast.names.size(), NO_ENTRY);
+        if (ast.root != AST_NONE) collectVariables(ast.root);
+        module.numVariables = module.variableNames.size();
+        if (ast.root != AST_NONE) block(ast.root);
+        emit(OP_HALT);
+        if (module.numRegisters() > MAX_REGISTERS) {
+            error = "program needs " + to_string(module.numRegisters()) + " registers, at most " +
+                    to_string(MAX_REGISTERS) + " are supported";
+            return false;
+        }
+        return true;
+    }
+};
+
+bool compileToBytecode(const Ast &ast, BytecodeModule &module, string &error) {
+    return BytecodeCompiler(ast, module).compile(error);
+}
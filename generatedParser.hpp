@@ -0,0 +1,211 @@
+// Generated from grammar.txt by `compiler --emit-parser`, do not edit.
+// Included after lrParser.hpp, BasicLRParser<GeneratedParseTables> parses with these tables.
+
+using namespace std;
+
+enum GeneratedTerminal {
+    T_END = 0,
+    T_ASSIGN = 1,
+    T_BOOLEAN = 2,
+    T_COLON = 3,
+    T_COMMA = 4,
+    T_DEDENT = 5,
+    T_ELIF = 6,
+    T_ELSE = 7,
+    T_EQUALTO = 8,
+    T_FLOAT = 9,
+    T_GREATERTHAN = 10,
+    T_IDENTIFIER = 11,
+    T_IF = 12,
+    T_INDENT = 13,
+    T_INPUT = 14,
+    T_INTEGER = 15,
+    T_LEFTPAREN = 16,
+    T_LEFTSQUARE = 17,
+    T_LESSTHAN = 18,
+    T_NEWLINE = 19,
+    T_PRINT = 20,
+    T_RIGHTPAREN = 21,
+    T_RIGHTSQUARE = 22,
+    T_STRING = 23,
+};
+
+enum GeneratedNonTerminal {
+    NT_S_PRIME = 24,
+    NT_assn_stmt = 25,
+    NT_block = 26,
+    NT_element = 27,
+    NT_elif_block = 28,
+    NT_elif_clause = 29,
+    NT_else_clause = 30,
+    NT_expr = 31,
+    NT_if_stmt = 32,
+    NT_input_stmt = 33,
+    NT_list = 34,
+    NT_list_ele = 35,
+    NT_literal = 36,
+    NT_print_stmt = 37,
+    NT_program = 38,
+    NT_relop = 39,
+    NT_simple_stmt = 40,
+    NT_stmt = 41,
+    NT_stmt_list = 42,
+};
+
+enum GeneratedProduction {
+    P_S_PRIME_0 = 0,
+    P_program_0 = 1,
+    P_stmt_list_0 = 2,
+    P_stmt_list_1 = 3,
+    P_stmt_0 = 4,
+    P_stmt_1 = 5,
+    P_if_stmt_0 = 6,
+    P_block_0 = 7,
+    P_elif_block_0 = 8,
+    P_elif_block_1 = 9,
+    P_elif_clause_0 = 10,
+    P_else_clause_0 = 11,
+    P_else_clause_1 = 12,
+    P_simple_stmt_0 = 13,
+    P_simple_stmt_1 = 14,
+    P_simple_stmt_2 = 15,
+    P_print_stmt_0 = 16,
+    P_print_stmt_1 = 17,
+    P_input_stmt_0 = 18,
+    P_input_stmt_1 = 19,
+    P_expr_0 = 20,
+    P_expr_1 = 21,
+    P_relop_0 = 22,
+    P_relop_1 = 23,
+    P_relop_2 = 24,
+    P_assn_stmt_0 = 25,
+    P_assn_stmt_1 = 26,
+    P_assn_stmt_2 = 27,
+    P_list_0 = 28,
+    P_list_ele_0 = 29,
+    P_list_ele_1 = 30,
+    P_list_ele_2 = 31,
+    P_element_0 = 32,
+    P_element_1 = 33,
+    P_literal_0 = 34,
+    P_literal_1 = 35,
+    P_literal_2 = 36,
+    P_literal_3 = 37,
+};
+
+struct GeneratedParseTables {
+    static constexpr uint64_t grammarHash = 0x5a2713c665028156ULL;
+    static constexpr LRMode mode = LR_CANONICAL;
+    static constexpr int numStates = 117;
+    static constexpr int numTerminals = 24;
+    static constexpr int numNonTerminals = 19;
+    static constexpr int endMarker = 0;
+    static constexpr size_t actionSlots = 144;
+    static constexpr size_t gotoSlots = 122;
+
+    static constexpr int32_t actionBase[117] = {
+        33, 0, 7, 3, 12, 0, 0, 0, 0, 0, 12, 38, 0, 0, 91, 1, 
+        1, 11, 0, 0, 0, 0, 0, 0, 12, 0, 0, 0, 0, 0, 0, 28, 
+        14, 0, 0, 15, 0, 0, 21, 34, 36, 0, 0, 0, 23, 0, 1, 0, 
+        37, 0, 0, 0, 0, 0, 0, 0, 53, 0, 0, 0, 0, 0, 46, 39, 
+        0, 49, 59, 0, 2, 0, 0, 66, 0, 60, 53, 78, 85, 0, 0, 87, 
+        0, 60, 87, 84, 89, 91, 0, 0, 0, 98, 0, 99, 108, 64, 71, 104, 
+        109, 111, 75, 82, 115, 116, 0, 0, 115, 116, 103, 104, 0, 0, 0, 111, 
+        0, 86, 93, 120, 0
+    };
+    static constexpr int32_t actionDefault[117] = {
+        -4, 0, 0, 0, 0, -14, -5, -16, -15, 0, 0, -4, -2, 0, 0, 0, 
+        0, 0, -6, -3, -38, -36, -28, -35, -32, -37, -26, -27, -25, -24, -23, 0, 
+        0, -38, -36, 0, -35, -37, 0, 0, 0, -38, -36, -35, -32, -37, -31, -34, 
+        0, -33, -38, -36, -21, -35, -37, -22, 0, -10, -19, -20, -17, -18, 0, -32, 
+        -29, 0, 0, -13, -10, -29, -30, 0, -5, 0, -4, 0, 0, -7, -9, 0, 
+        -6, -4, 0, 0, 0, 0, -3, -8, -11, 0, -12, 0, -10, 0, 0, 0, 
+        -13, -10, -4, -4, 0, 0, -7, -9, 0, 0, 0, 0, -8, -8, -11, 0, 
+        -12, 0, -4, 0, -8
+    };
+    static constexpr int32_t actionNext[144] = {
+        -1, 14, 21, 34, 33, 64, 67, 77, 67, 22, 35, 23, 36, 34, 42, 24, 
+        37, 25, 15, 17, 35, 43, 40, 26, 38, 42, 37, 44, 18, 45, 51, 19, 
+        43, 57, 38, 46, 59, 52, 44, 53, 45, 42, 60, 54, 2, 3, 46, 4, 
+        43, 2, 3, 55, 4, 5, 44, 61, 45, 62, 5, 65, 2, 72, 46, 4, 
+        2, 72, 66, 4, 70, 5, 15, 2, 72, 5, 4, 2, 72, 15, 4, 81, 
+        5, 84, 2, 72, 5, 4, 2, 72, 85, 4, 86, 5, 88, 2, 72, 5, 
+        4, 2, 72, 29, 4, 30, 5, 57, 2, 72, 5, 4, 90, 31, 92, 94, 
+        95, 5, 96, 15, 102, 96, 107, 108, 109, 110, 92, 112, 114, 117, 0, 0, 
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    };
+    static constexpr int32_t actionCheck[144] = {
+        9, 1, 13, 16, 15, 46, 57, 67, 68, 13, 16, 13, 16, 17, 24, 13, 
+        16, 13, 2, 3, 17, 24, 17, 13, 16, 44, 17, 24, 4, 24, 31, 10, 
+        44, 32, 17, 24, 35, 31, 44, 31, 44, 63, 38, 31, 0, 0, 44, 0, 
+        63, 11, 11, 31, 11, 0, 63, 39, 63, 40, 11, 48, 65, 65, 63, 65, 
+        74, 74, 56, 74, 62, 65, 66, 81, 81, 74, 81, 93, 93, 71, 93, 73, 
+        81, 75, 94, 94, 93, 94, 98, 98, 76, 98, 79, 94, 82, 99, 99, 98, 
+        99, 113, 113, 14, 113, 14, 99, 83, 114, 114, 113, 114, 84, 14, 85, 89, 
+        91, 114, 92, 95, 96, 97, 100, 101, 104, 105, 106, 107, 111, 115, -1, -1, 
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+    };
+    static constexpr int32_t gotoBase[19] = {
+        0, 0, 0, 0, 0, 4, 2, 0, 3, 0, 5, 0, 0, 0, 0, 0, 
+        4, 0, 1
+    };
+    static constexpr int32_t gotoDefault[19] = {
+        -1, 5, 57, 46, 67, 68, 77, 15, 72, 7, 47, 48, 49, 8, 9, 31, 
+        73, 81, 12
+    };
+    static constexpr int32_t gotoNext[122] = {
+        11, 0, 0, 6, 10, 0, 0, 0, 0, 0, 0, 11, 19, 27, 6, 10, 
+        38, 40, 26, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 55, 
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 62, 0, 0, 0, 
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 70, 
+        0, 74, 75, 0, 78, 0, 0, 79, 0, 0, 0, 82, 0, 0, 0, 0, 
+        0, 0, 86, 88, 90, 92, 0, 0, 0, 0, 0, 0, 96, 98, 99, 100, 
+        97, 103, 102, 104, 105, 97, 0, 0, 0, 0, 110, 112, 0, 0, 0, 0, 
+        0, 114, 0, 115, 0, 0, 0, 0, 0, 0
+    };
+    static constexpr int32_t gotoCheck[122] = {
+        17, -1, -1, 8, 16, -1, -1, -1, -1, -1, -1, 17, 18, 12, 8, 16, 
+        12, 12, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 12, 
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 11, -1, -1, -1, 
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 11, 
+        -1, 17, 7, -1, 4, -1, -1, 7, -1, -1, -1, 18, -1, -1, -1, -1, 
+        -1, -1, 18, 2, 2, 2, -1, -1, -1, -1, -1, -1, 4, 17, 17, 7, 
+        5, 4, 6, 18, 18, 5, -1, -1, -1, -1, 2, 2, -1, -1, -1, -1, 
+        -1, 17, -1, 18, -1, -1, -1, -1, -1, -1
+    };
+    static constexpr int32_t prodLhs[38] = {
+        24, 38, 42, 42, 41, 41, 32, 26, 28, 28, 29, 30, 30, 40, 40, 40, 
+        37, 37, 33, 33, 31, 31, 39, 39, 39, 25, 25, 25, 34, 35, 35, 35, 
+        27, 27, 36, 36, 36, 36
+    };
+    static constexpr int32_t prodLength[38] = {
+        1, 1, 2, 0, 1, 2, 6, 5, 2, 0, 4, 3, 0, 1, 1, 1, 
+        4, 4, 4, 4, 3, 3, 1, 1, 1, 3, 3, 3, 3, 3, 1, 0, 
+        1, 1, 1, 1, 1, 1
+    };
+    static constexpr const char *symbolNames[43] = {
+        "$", "ASSIGN", "BOOLEAN", "COLON", "COMMA", "DEDENT", "ELIF", "ELSE", 
+        "EQUALTO", "FLOAT", "GREATERTHAN", "IDENTIFIER", "IF", "INDENT", "INPUT", "INTEGER", 
+        "LEFTPAREN", "LEFTSQUARE", "LESSTHAN", "NEWLINE", "PRINT", "RIGHTPAREN", "RIGHTSQUARE", "STRING", 
+        "S'", "assn_stmt", "block", "element", "elif_block", "elif_clause", "else_clause", "expr", 
+        "if_stmt", "input_stmt", "list", "list_ele", "literal", "print_stmt", "program", "relop", 
+        "simple_stmt", "stmt", "stmt_list"
+    };
+
+    static constexpr int32_t action(int state, int terminal) {
+        int i = actionBase[state] + terminal;
+        return actionCheck[i] == state ? actionNext[i] : actionDefault[state];
+    }
+
+    static constexpr int gotoState(int state, int A) {
+        int i = gotoBase[A - numTerminals] + state;
+        return gotoCheck[i] == A - numTerminals ? gotoNext[i] : gotoDefault[A - numTerminals];
+    }
+
+    static constexpr bool isTerminalId(int id) {
+        return id < numTerminals;
+    }
+};
+
+typedef BasicLRParser<GeneratedParseTables> GeneratedLRParser;
+typedef BasicParseTree<GeneratedParseTables> GeneratedParseTree;
@@ -0,0 +1,196 @@
+
+using namespace std;
+
+// Runs a BytecodeModule. The registers are one array of Values: the
+// variables, undefined until assigned, then the constants. Dispatch is a
+// computed goto on GCC and Clang, one indirect jump per instruction at the
+// end of every handler, and a switch elsewhere or with -DVM_SWITCH_DISPATCH.
+// Nothing is allocated per instruction: print appends to an output buffer
+// that is written out at 64 KiB, before every input() and at the end, and
+// input() reads into one reused line. Runtime errors stop the program with
+// a Python style message. Once compileNative() succeeds run() executes the
+// native code of jit.hpp instead, which calls execute() for whatever it does
+// not handle itself.
+
+#if defined(__GNUC__) && !defined(VM_SWITCH_DISPATCH)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+class Interpreter {
+private:
+    const BytecodeModule &module;
+    istream &in;
+    ostream &out;
+    vector<Value> registers;
+    string output;
+    string line;
+    string typeError;
+
+    void flush() {
+        out.write(output.data(), output.size());
+        output.clear();
+    }
+
+    int fail(const Instruction *pc, const string &message) {
+        flush();
+        uint32_t where = module.lines[pc - module.code.data()];
+        error = (where ? "line " + to_string(where) + ": " : string()) + message;
+        return -1;
+    }
+
+    int undefined(const Instruction *pc, uint32_t r) {
+        return fail(pc, "NameError: name '" + string(module.variableName(r)) + "' is not defined");
+    }
+
+    // the general handler of pc's instruction, for what the fast paths of
+    // run() and the native code leave to it: 1 or 0 for a comparison that
+    // holds or not, 0 for anything else, -1 with error set
+    int execute(const Instruction *pc) {
+        Value *r = registers.data();
+        switch (pc->op) {
+            case OP_MOVE:
+                if (r[pc->b].tag == V_UNDEFINED) return undefined(pc, pc->b);
+                r[pc->a] = r[pc->b];
+                return 0;
+            case OP_PRINT:
+                if (r[pc->a].tag == V_UNDEFINED) return undefined(pc, pc->a);
+                module.appendValue(output, r[pc->a]);
+                output += '\n';
+                if (output.size() >= (1 << 16)) flush();
+                return 0;
+            case OP_INPUT:
+                if (r[pc->a].tag == V_UNDEFINED) return undefined(pc, pc->a);
+                module.appendValue(output, r[pc->a]);
+                flush();
+                out.flush();
+                if (!getline(in, line)) return fail(pc, "EOFError: EOF when reading a line");
+                return 0;
+            case OP_UNLESS_LESS: case OP_UNLESS_GREATER: case OP_UNLESS_EQUAL: {
+                const Value &x = r[pc->a], &y = r[pc->b];
+                if (x.tag == V_UNDEFINED) return undefined(pc, pc->a);
+                if (y.tag == V_UNDEFINED) return undefined(pc, pc->b);
+                if (pc->op == OP_UNLESS_EQUAL) return module.equal(x, y);
+                bool less = pc->op == OP_UNLESS_LESS;
+                int holds = module.ordered(x, y, less, less ? "<" : ">", typeError);
+                return holds < 0 ? fail(pc, typeError) : holds;
+            }
+            default:
+                return 0;
+        }
+    }
+
+    static int nativeHandler(void *self, uint32_t pc) {
+        Interpreter &interpreter = *static_cast<Interpreter*>(self);
+        return interpreter.execute(interpreter.module.code.data() + pc);
+    }
+
+    // stores the instructions a run executed however it returns
+    struct Counter {
+        uint64_t &total;
+        uint64_t n = 0;
+        ~Counter() {
+            total = n;
+            stats.add(STAT_INSTRUCTIONS, n);
+        }
+    };
+
+public:
+    string error;                   // why the program stopped, empty when it ran to the end
+    uint64_t executed = 0;          // instructions the last run executed
+    JitCode native;
+
+    Interpreter(const BytecodeModule &module, istream &in, ostream &out) : module(module), in(in), out(out) {
+        output.reserve(1 << 16);
+    }
+
+    // compiles the module to native code for run() to use from then on,
+    // false with why set when it cannot, run() interpreting it as before
+    bool compileNative(string &why) {
+        return native.compile(module, nativeHandler, why);
+    }
+
+    // runs the program from the start, false with error set on a runtime error
+    bool run() {
+        PhaseScope phase(native.ready() ? "run native" : "run");
+        error.clear();
+        registers.assign(module.numVariables, Value());
+        registers.insert(registers.end(), module.constants.begin(), module.constants.end());
+        Value *r = registers.data();
+        const Instruction *code = module.code.data();
+        const Instruction *pc = code;
+        Counter counter{executed};
+        if (native.ready()) {
+            if (native.run(r, this, counter.n) != 0) return false;
+            flush();
+            return true;
+        }
+
+#ifdef VM_COMPUTED_GOTO
+        static void *const dispatch[OP_COUNT] = {
+            &&L_MOVE, &&L_PRINT, &&L_INPUT, &&L_UNLESS_LESS, &&L_UNLESS_GREATER, &&L_UNLESS_EQUAL, &&L_JUMP, &&L_HALT,
+        };
+#define VM_CASE(op) L_##op:
+#define VM_NEXT() counter.n++; goto *dispatch[pc->op]
+        VM_NEXT();
+#else
+#define VM_CASE(op) case OP_##op:
+#define VM_NEXT() counter.n++; continue
+        for (;;) switch (pc->op) {
+#endif
+
+        VM_CASE(MOVE) {
+            if (r[pc->b].tag != V_UNDEFINED) r[pc->a] = r[pc->b];
+            else if (execute(pc) < 0) return false;
+            ++pc;
+            VM_NEXT();
+        }
+        VM_CASE(PRINT) {
+            if (execute(pc) < 0) return false;
+            ++pc;
+            VM_NEXT();
+        }
+        VM_CASE(INPUT) {
+            if (execute(pc) < 0) return false;
+            ++pc;
+            VM_NEXT();
+        }
+        VM_CASE(UNLESS_LESS) {
+            const Value &x = r[pc->a], &y = r[pc->b];
+            int holds;
+            if (x.tag == V_INT && y.tag == V_INT) holds = x.i < y.i;
+            else if ((holds = execute(pc)) < 0) return false;
+            pc = holds ? pc + 1 : code + pc->c;
+            VM_NEXT();
+        }
+        VM_CASE(UNLESS_GREATER) {
+            const Value &x = r[pc->a], &y = r[pc->b];
+            int holds;
+            if (x.tag == V_INT && y.tag == V_INT) holds = x.i > y.i;
+            else if ((holds = execute(pc)) < 0) return false;
+            pc = holds ? pc + 1 : code + pc->c;
+            VM_NEXT();
+        }
+        VM_CASE(UNLESS_EQUAL) {
+            const Value &x = r[pc->a], &y = r[pc->b];
+            int holds;
+            if (x.tag == V_INT && y.tag == V_INT) holds = x.i == y.i;
+            else if ((holds = execute(pc)) < 0) return false;
+            pc = holds ? pc + 1 : code + pc->c;
+            VM_NEXT();
+        }
+        VM_CASE(JUMP) {
+            pc = code + pc->c;
+            VM_NEXT();
+        }
+        VM_CASE(HALT) {
+            flush();
+            return true;
+        }
+
+#ifndef VM_COMPUTED_GOTO
+        }
+#endif
+#undef VM_CASE
+#undef VM_NEXT
+    }
+};
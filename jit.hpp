@@ -0,0 +1,268 @@
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_X86_64 1
+#endif
+
+using namespace std;
+
+// Compiles a BytecodeModule to x86-64 machine code in an mmap'd buffer,
+// written while it is read/write and then made read/execute. Every
+// instruction becomes a run of native code over the same register array
+// the interpreter uses: moves copy the 16 byte Values, jumps are jumps and
+// comparisons of two ints or two floats are a cmp or ucomisd and a branch,
+// guarded by type checks that constant operands need not repeat. Anything
+// else (print, input, other operand types and all runtime errors) calls back
+// into the interpreter's handler for that one instruction and carries on
+// natively from its result. Elsewhere than x86-64 Linux compile() fails and
+// the interpreter runs the program.
+//
+// The code is one function, int (Value *registers, void *self, uint64_t *executed),
+// 0 when the program halts and 1 on an error. rbx holds the registers, r12
+// self, r13 counts the instructions executed and r14 points to where it is
+// stored on the way out.
+
+// the interpreter's handler for the instruction at pc: 1 or 0 for a
+// comparison that holds or not, 0 for anything else, -1 on an error
+typedef int (*JitHandler)(void *self, uint32_t pc);
+
+class JitCode {
+private:
+    typedef int (*Entry)(Value *registers, void *self, uint64_t *executed);
+
+    void *memory = nullptr;
+    size_t mapped = 0;
+
+    void release() {
+#ifdef JIT_X86_64
+        if (memory) munmap(memory, mapped);
+#endif
+        memory = nullptr;
+        mapped = 0;
+    }
+
+    // x86-64 encoding, registers are addressed as [rbx + disp32]
+    struct Assembler {
+        vector<uint8_t> bytes;
+        vector<size_t> labels;                      // native offset of every instruction, then fail and exit
+        vector<pair<size_t, uint32_t>> fixups;      // rel32 position → label
+
+        void emit(initializer_list<uint8_t> b) {
+            bytes.insert(bytes.end(), b);
+        }
+
+        void imm32(uint32_t v) {
+            for (int k = 0; k < 4; ++k) bytes.push_back(v >> (8 * k));
+        }
+
+        void imm64(uint64_t v) {
+            for (int k = 0; k < 8; ++k) bytes.push_back(v >> (8 * k));
+        }
+
+        // op (with any prefixes), a ModRM for [rbx + disp32] with reg, disp
+        void modrm(initializer_list<uint8_t> op, int reg, uint32_t disp) {
+            emit(op);
+            bytes.push_back(0x80 | (reg << 3) | 3);
+            imm32(disp);
+        }
+
+        // jcc (0x80 | cc) or jmp (0) to a label
+        void jump(int cc, uint32_t label) {
+            if (cc) emit({0x0f, uint8_t(0x80 | cc)});
+            else bytes.push_back(0xe9);
+            fixups.push_back({bytes.size(), label});
+            imm32(0);
+        }
+
+        void patch() {
+            for (auto &[at, label] : fixups) {
+                int32_t rel = int32_t(labels[label] - (at + 4));
+                memcpy(&bytes[at], &rel, 4);
+            }
+        }
+    };
+
+    enum Condition { CC_P = 0xa, CC_E = 0x4, CC_NE = 0x5, CC_S = 0x8, CC_BE = 0x6, CC_GE = 0xd, CC_LE = 0xe };
+
+    static uint32_t tagAt(uint32_t r) { return r * sizeof(Value); }
+    static uint32_t payloadAt(uint32_t r) { return r * sizeof(Value) + offsetof(Value, i); }
+
+    // the tag register r is known to have, V_UNDEFINED when only known at run time
+    static ValueTag knownTag(const BytecodeModule &module, uint32_t r) {
+        return r < module.numVariables ? V_UNDEFINED : module.constants[r - module.numVariables].tag;
+    }
+
+    // calls handler(self, pc) and leaves its result in eax, an error going to fail
+    static void callHandler(Assembler &as, JitHandler handler, uint32_t pc, uint32_t fail) {
+        as.emit({0x4c, 0x89, 0xe7});                // mov rdi, r12
+        as.bytes.push_back(0xbe);                   // mov esi, pc
+        as.imm32(pc);
+        as.emit({0x48, 0xb8});                      // mov rax, handler
+        as.imm64(uint64_t(handler));
+        as.emit({0xff, 0xd0});                      // call rax
+        as.emit({0x85, 0xc0});                      // test eax, eax
+        as.jump(CC_S, fail);
+    }
+
+    // jumps to slow unless register r holds tag
+    static void guardTag(Assembler &as, const BytecodeModule &module, uint32_t r, ValueTag tag, uint32_t slow) {
+        if (knownTag(module, r) == tag) return;
+        as.modrm({0x80}, 7, tagAt(r));             // cmp byte [r].tag, tag
+        as.bytes.push_back(tag);
+        as.jump(CC_NE, slow);
+    }
+
+    static void compileCompare(Assembler &as, const BytecodeModule &module, const Instruction &ins, uint32_t pc,
+                               JitHandler handler) {
+        uint32_t fail = module.code.size(), next = pc + 1;
+        ValueTag a = knownTag(module, ins.a), b = knownTag(module, ins.b);
+        // a constant operand that is neither kind leaves only the handler
+        bool canInt = (a == V_UNDEFINED || a == V_INT) && (b == V_UNDEFINED || b == V_INT);
+        bool canFloat = (a == V_UNDEFINED || a == V_FLOAT) && (b == V_UNDEFINED || b == V_FLOAT);
+        // labels past the fail and exit ones are local to this instruction
+        uint32_t floats = as.labels.size(), slow = floats + 1;
+        as.labels.resize(slow + 1);
+
+        if (canInt) {
+            guardTag(as, module, ins.a, V_INT, canFloat ? floats : slow);
+            guardTag(as, module, ins.b, V_INT, canFloat ? floats : slow);
+            as.modrm({0x48, 0x8b}, 0, payloadAt(ins.a));   // mov rax, [a].i
+            as.modrm({0x48, 0x3b}, 0, payloadAt(ins.b));   // cmp rax, [b].i
+            Condition unless = ins.op == OP_UNLESS_LESS ? CC_GE : ins.op == OP_UNLESS_GREATER ? CC_LE : CC_NE;
+            as.jump(unless, ins.c);
+            as.jump(0, next);
+        }
+        as.labels[floats] = as.bytes.size();
+        if (canFloat) {
+            guardTag(as, module, ins.a, V_FLOAT, slow);
+            guardTag(as, module, ins.b, V_FLOAT, slow);
+            // ucomisd sets CF and ZF on unordered, so "above" is false for a NaN
+            // and a < b is tested as b above a
+            bool swap = ins.op == OP_UNLESS_LESS;
+            as.modrm({0xf2, 0x0f, 0x10}, 0, payloadAt(swap ? ins.b : ins.a));  // movsd xmm0, [x].f
+            as.modrm({0x66, 0x0f, 0x2e}, 0, payloadAt(swap ? ins.a : ins.b));  // ucomisd xmm0, [y].f
+            if (ins.op == OP_UNLESS_EQUAL) {
+                as.jump(CC_NE, ins.c);
+                as.jump(CC_P, ins.c);
+            } else {
+                as.jump(CC_BE, ins.c);
+            }
+            as.jump(0, next);
+        }
+        as.labels[slow] = as.bytes.size();
+        callHandler(as, handler, pc, fail);
+        as.jump(CC_E, ins.c);
+    }
+
+public:
+    size_t codeBytes = 0;           // of native code the last compile() made
+
+    JitCode() = default;
+    JitCode(const JitCode&) = delete;
+    JitCode &operator=(const JitCode&) = delete;
+    ~JitCode() { release(); }
+
+    bool ready() const {
+        return memory != nullptr;
+    }
+
+    // compiles module, false with error set when it cannot be run natively
+    bool compile(const BytecodeModule &module, JitHandler handler, string &error) {
+        PhaseScope phase("jit compile");
+        release();
+#ifndef JIT_X86_64
+        (void)module;
+        (void)handler;
+        error = "native code needs x86-64 Linux";
+        return false;
+#else
+        if (uint64_t(module.numRegisters()) * sizeof(Value) > INT32_MAX) {
+            error = "too many registers for native code";
+            return false;
+        }
+        uint32_t n = module.code.size(), fail = n, exit = n + 1;
+        Assembler as;
+        as.labels.assign(n + 2, 0);
+        as.emit({0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56});   // push rbx, r12, r13, r14
+        as.emit({0x48, 0x83, 0xec, 0x08});                     // sub rsp, 8 to align calls
+        as.emit({0x48, 0x89, 0xfb});                           // mov rbx, rdi
+        as.emit({0x49, 0x89, 0xf4});                           // mov r12, rsi
+        as.emit({0x49, 0x89, 0xd6});                           // mov r14, rdx
+        as.emit({0x45, 0x31, 0xed});                           // xor r13d, r13d
+
+        for (uint32_t pc = 0; pc < n; ++pc) {
+            const Instruction &ins = module.code[pc];
+            as.labels[pc] = as.bytes.size();
+            as.emit({0x49, 0xff, 0xc5});                       // inc r13
+            switch (ins.op) {
+                case OP_MOVE: {
+                    uint32_t slow = as.labels.size();
+                    as.labels.push_back(0);
+                    bool mayBeUndefined = ins.b < module.numVariables;
+                    if (mayBeUndefined) {
+                        as.modrm({0x80}, 7, tagAt(ins.b));    // cmp byte [b].tag, V_UNDEFINED
+                        as.bytes.push_back(V_UNDEFINED);
+                        as.jump(CC_E, slow);
+                    }
+                    as.modrm({0x48, 0x8b}, 0, tagAt(ins.b));      // mov rax, [b]
+                    as.modrm({0x48, 0x8b}, 2, payloadAt(ins.b));  // mov rdx, [b] + 8
+                    as.modrm({0x48, 0x89}, 0, tagAt(ins.a));      // mov [a], rax
+                    as.modrm({0x48, 0x89}, 2, payloadAt(ins.a));  // mov [a] + 8, rdx
+                    if (mayBeUndefined) {
+                        as.jump(0, pc + 1);
+                        as.labels[slow] = as.bytes.size();
+                        callHandler(as, handler, pc, fail);
+                    }
+                    break;
+                }
+                case OP_PRINT: case OP_INPUT:
+                    callHandler(as, handler, pc, fail);
+                    break;
+                case OP_UNLESS_LESS: case OP_UNLESS_GREATER: case OP_UNLESS_EQUAL:
+                    compileCompare(as, module, ins, pc, handler);
+                    break;
+                case OP_JUMP:
+                    as.jump(0, ins.c);
+                    break;
+                case OP_HALT:
+                    as.emit({0x31, 0xc0});                     // xor eax, eax
+                    as.jump(0, exit);
+                    break;
+                default:
+                    error = string("no native code for ") + opcodeNames[ins.op];
+                    return false;
+            }
+        }
+        // the compiler always ends with a HALT, so nothing falls through to here
+        as.labels[fail] = as.bytes.size();
+        as.emit({0xb8, 1, 0, 0, 0});                           // mov eax, 1
+        as.labels[exit] = as.bytes.size();
+        as.emit({0x4d, 0x89, 0x2e});                           // mov [r14], r13
+        as.emit({0x48, 0x83, 0xc4, 0x08});                     // add rsp, 8
+        as.emit({0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5b});   // pop r14, r13, r12, rbx
+        as.bytes.push_back(0xc3);                              // ret
+        as.patch();
+
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t size = (as.bytes.size() + page - 1) / page * page;
+        void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            error = string("mmap failed: ") + strerror(errno);
+            return false;
+        }
+        memcpy(p, as.bytes.data(), as.bytes.size());
+        if (mprotect(p, size, PROT_READ | PROT_EXEC) != 0) {
+            error = string("mprotect failed: ") + strerror(errno);
+            munmap(p, size);
+            return false;
+        }
+        memory = p;
+        mapped = size;
+        codeBytes = as.bytes.size();
+        return true;
+#endif
+    }
+
+    // runs the compiled program over registers, 0 when it halts and 1 on an error
+    int run(Value *registers, void *self, uint64_t &executed) const {
+        return reinterpret_cast<Entry>(memory)(registers, self, &executed);
+    }
+};
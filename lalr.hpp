@@ -0,0 +1,230 @@
+
+using namespace std;
+
+// LALR(1) construction by DeRemer–Pennello lookahead propagation.
+// The LR(0) automaton is built first, then the lookaheads of every
+// nonterminal transition (p, A) are found with two inclusion problems:
+//   Read(p, A)   = terminals shiftable right after A, plus what nullable
+//                  nonterminals after A can read
+//   Follow(p, A) = Read(p, A) plus Follow(p', B) for every B → β A γ with
+//                  γ nullable and p' --β--> p
+// Both are solved by solveInclusions. A kernel item [A → α • β] of state q
+// gets Follow(p, A) for every p --α--> q, and the states come out in the same
+// DFA_State shape as the canonical builder, with LR(1) items for kernels.
+
+// the item with its lookahead replaced by the end marker, i.e. its LR(0) core
+inline Item itemCore(Item it, const CFG &grammar) {
+    return (it & ~uint64_t(0xFFFFFF)) | uint64_t(grammar.endMarker);
+}
+
+ItemSet kernelCore(const ItemSet &kernel, const CFG &grammar) {
+    ItemSet core;
+    for (Item it : kernel.items) core.items.push_back(itemCore(it, grammar));
+    core.finalize();
+    return core;
+}
+
+// LR(0) closure, items carry the end marker as a placeholder lookahead
+ItemSet computeClosureLR0(const ItemSet &kernel, const CFG &grammar) {
+    ItemSet result = kernel;
+    vector<char> added(grammar.numSymbols - grammar.numTerminals, 0);
+    vector<int> work;
+    for (Item it : kernel.items) {
+        int B = itemNextSymbol(it, grammar);
+        if (B >= 0 && !grammar.isTerminalId(B) && !added[B - grammar.numTerminals]) {
+            added[B - grammar.numTerminals] = 1;
+            work.push_back(B);
+        }
+    }
+    while (!work.empty()) {
+        int B = work.back();
+        work.pop_back();
+        for (int prod : grammar.prodsByLhs[B - grammar.numTerminals]) {
+            result.items.push_back(makeItem(prod, 0, grammar.endMarker));
+            if (grammar.rhsLength(prod) == 0) continue;
+            int C = grammar.rhsBegin(prod)[0];
+            if (!grammar.isTerminalId(C) && !added[C - grammar.numTerminals]) {
+                added[C - grammar.numTerminals] = 1;
+                work.push_back(C);
+            }
+        }
+    }
+    result.finalize();
+    stats.add(STAT_CLOSURE_CALLS, 1);
+    stats.add(STAT_ITEMS_CREATED, result.items.size() - kernel.items.size());
+    return result;
+}
+
+// target of the transition on X out of state, -1 if there is none
+int gotoState(const DFA_State &state, int X) {
+    auto it = lower_bound(state.edges.begin(), state.edges.end(), make_pair(X, INT_MIN));
+    return it != state.edges.end() && it->first == X ? it->second : -1;
+}
+
+vector<DFA_State> buildLALRCollection(CFG &grammar, const LRBuildOptions &options = LRBuildOptions()) {
+    grammar.analyze();
+    checkItemLimits(grammar);
+    const GrammarAnalysis &an = grammar.analysis;
+    int numT = grammar.numTerminals;
+
+    ItemSet startKernel;
+    startKernel.items.push_back(makeItem(0, 0, grammar.endMarker));
+    startKernel.finalize();
+    vector<DFA_State> states = buildItemAutomaton(
+        startKernel, [&](const ItemSet &kernel) { return computeClosureLR0(kernel, grammar); }, false, grammar);
+
+    PhaseScope lookaheadPhase("LALR lookaheads");
+    // 1) Number the nonterminal transitions, transId runs parallel to each state's edges
+    vector<vector<int> > transId(states.size());
+    vector<pair<int, int> > trans;   // (from state, nonterminal)
+    for (const DFA_State &state : states) {
+        for (const auto &edge : state.edges) {
+            transId[state.id].push_back(grammar.isTerminalId(edge.first) ? -1 : (int)trans.size());
+            if (!grammar.isTerminalId(edge.first)) trans.push_back({state.id, edge.first});
+        }
+    }
+    auto transitionOf = [&](int p, int A) {
+        const vector<pair<int, int> > &edges = states[p].edges;
+        auto it = lower_bound(edges.begin(), edges.end(), make_pair(A, INT_MIN));
+        return transId[p][it - edges.begin()];
+    };
+
+    // 2) Read: direct reads, then through transitions on nullable nonterminals
+    int startNT = grammar.rhsBegin(0)[0];
+    vector<SymbolSet> follow(trans.size(), SymbolSet(numT));
+    vector<vector<int> > succ(trans.size());
+    for (size_t t = 0; t < trans.size(); ++t) {
+        int r = gotoState(states[trans[t].first], trans[t].second);
+        for (size_t e = 0; e < states[r].edges.size(); ++e) {
+            int X = states[r].edges[e].first;
+            if (grammar.isTerminalId(X)) follow[t].set(X);
+            else if (an.nullable[X]) succ[transId[r][e]].push_back(t);
+        }
+        if (trans[t].first == 0 && trans[t].second == startNT) follow[t].set(grammar.endMarker);
+    }
+    solveInclusions(follow, succ);
+
+    // 3) Walk every production from every transition on its lhs, collecting
+    //    includes edges and which transitions feed each kernel item
+    // feeds[q][k]: transitions whose Follow reaches kernel item k of q, -1 for the end marker
+    vector<vector<vector<int> > > feeds(states.size());
+    for (const DFA_State &state : states) feeds[state.id].resize(state.kernel.items.size());
+    for (auto &list : succ) list.clear();
+
+    auto walk = [&](int p, int prod, int from) {
+        const int *rhs = grammar.rhsBegin(prod);
+        int len = grammar.rhsLength(prod);
+        // nullableFrom[i]: rhs[i..] can vanish
+        vector<char> nullableFrom(len + 1, 1);
+        for (int i = len - 1; i >= 0; --i) nullableFrom[i] = nullableFrom[i + 1] && an.nullable[rhs[i]];
+        int q = p;
+        for (int i = 0; i < len; ++i) {
+            int X = rhs[i];
+            if (from >= 0 && !grammar.isTerminalId(X) && nullableFrom[i + 1]) {
+                succ[from].push_back(transitionOf(q, X));
+            }
+            q = gotoState(states[q], X);
+            Item core = makeItem(prod, i + 1, grammar.endMarker);
+            const vector<Item> &kernel = states[q].kernel.items;
+            size_t k = lower_bound(kernel.begin(), kernel.end(), core) - kernel.begin();
+            feeds[q][k].push_back(from);
+        }
+    };
+    feeds[0][0].push_back(-1);   // S' → • program, $
+    walk(0, 0, -1);
+    for (size_t t = 0; t < trans.size(); ++t) {
+        for (int prod : grammar.prodsByLhs[trans[t].second - numT]) walk(trans[t].first, prod, t);
+    }
+    solveInclusions(follow, succ);
+
+    // 4) Kernel lookaheads, then closures under them
+    PhaseScope closurePhase("LALR closures");
+    ClosureEngine localEngine(grammar);
+    ClosureEngine &engine = options.engine ? *options.engine : localEngine;
+    for (DFA_State &state : states) {
+        ItemSet kernel;
+        for (size_t k = 0; k < state.kernel.items.size(); ++k) {
+            Item core = state.kernel.items[k];
+            SymbolSet lookaheads(numT);
+            for (int t : feeds[state.id][k]) {
+                if (t < 0) lookaheads.set(grammar.endMarker);
+                else lookaheads.unionWith(follow[t]);
+            }
+            lookaheads.forEach([&](int la) { kernel.items.push_back(makeItem(itemProd(core), itemDot(core), la)); });
+        }
+        kernel.finalize();
+        state.kernel = kernel;
+        state.hasClosure = !options.kernelOnly;
+        state.items = options.kernelOnly ? ItemSet() : engine.closure(kernel);
+        state.isAccepting = kernel.contains(makeItem(0, 1, grammar.endMarker));
+    }
+
+    return states;
+}
+
+// canonical LR(1) or LALR(1), as options.mode says
+vector<DFA_State> buildLRCollection(CFG &grammar, const LRBuildOptions &options = LRBuildOptions()) {
+    return options.mode == LR_LALR ? buildLALRCollection(grammar, options) : buildCanonicalCollection(grammar, options);
+}
+
+
+// A reduce/reduce conflict: two productions complete in one state on the same lookahead
+struct ReduceConflict {
+    int state;
+    int lookahead;
+    int prodA, prodB;
+
+    bool operator<(const ReduceConflict &other) const {
+        return tie(state, lookahead, prodA, prodB) < tie(other.state, other.lookahead, other.prodA, other.prodB);
+    }
+};
+
+// reduce/reduce conflicts of one item set, reported under the given state id
+void findReduceConflicts(const ItemSet &items, int state, const CFG &grammar, set<ReduceConflict> &out) {
+    unordered_map<int, vector<int> > byLookahead;   // lookahead -> completed productions
+    for (Item it : items.items) {
+        if (itemNextSymbol(it, grammar) >= 0 || itemProd(it) == 0) continue;
+        byLookahead[itemLookahead(it)].push_back(itemProd(it));
+    }
+    for (auto &entry : byLookahead) {
+        vector<int> &prods = entry.second;
+        for (size_t i = 0; i < prods.size(); ++i) {
+            for (size_t j = i + 1; j < prods.size(); ++j) {
+                out.insert({state, entry.first, min(prods[i], prods[j]), max(prods[i], prods[j])});
+            }
+        }
+    }
+}
+
+// Compares an LALR(1) collection against the canonical one: state counts, and
+// the reduce/reduce conflicts that only appear because states were merged.
+// Returns the number of such conflicts.
+size_t reportLALRMerge(const vector<DFA_State> &canonical, const vector<DFA_State> &lalr, const CFG &grammar,
+                       ostream &out) {
+    out << "LR(1) states: " << canonical.size() << ", LALR(1) states: " << lalr.size() << "\n";
+
+    unordered_map<ItemSet, int, ItemSetHash> byCore;
+    for (const DFA_State &state : lalr) byCore[kernelCore(state.kernel, grammar)] = state.id;
+
+    // conflicts LR(1) already has, filed under the LALR state they merge into
+    set<ReduceConflict> before, after;
+    ClosureCache canonicalCache(grammar), lalrCache(grammar);
+    for (const DFA_State &state : canonical) {
+        auto found = byCore.find(kernelCore(state.kernel, grammar));
+        if (found == byCore.end()) continue;
+        findReduceConflicts(canonicalCache.get(state), found->second, grammar, before);
+    }
+    for (const DFA_State &state : lalr) findReduceConflicts(lalrCache.get(state), state.id, grammar, after);
+
+    size_t introduced = 0;
+    for (const ReduceConflict &c : after) {
+        if (before.count(c)) continue;
+        introduced++;
+        out << "reduce/reduce conflict introduced by merging in LALR state " << c.state << " on "
+            << grammar.symbolNames[c.lookahead] << ":\n"
+            << "  " << itemToString(makeItem(c.prodA, grammar.rhsLength(c.prodA), c.lookahead), grammar) << "\n"
+            << "  " << itemToString(makeItem(c.prodB, grammar.rhsLength(c.prodB), c.lookahead), grammar) << "\n";
+    }
+    if (introduced == 0) out << "no reduce/reduce conflicts introduced by merging\n";
+    return introduced;
+}
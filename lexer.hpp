@@ -1,190 +1,630 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace std;
 
+// Kinds of tokens the lexer produces, the first seven in the order their regex is tried
+enum TokenKind : uint8_t {
+    TK_STRING,
+    TK_FLOAT,
+    TK_INTEGER,
+    TK_BOOLEAN,
+    TK_IDENTIFIER,
+    TK_OPERATOR,
+    TK_PUNCTUATOR,
+    TK_KEYWORD,
+    TK_INDENT,
+    TK_DEDENT,
+    TK_NEWLINE,
+    TK_COUNT
+};
+
+const char* tokenKindNames[TK_COUNT] = {
+    "STRING", "FLOAT", "INTEGER", "BOOLEAN", "IDENTIFIER", "OPERATOR",
+    "PUNCTUATOR", "KEYWORD", "INDENT", "DEDENT", "NEWLINE",
+};
+
+const uint32_t NO_SYMBOL = UINT32_MAX;
+
+// Compact token, the lexeme lives in the source buffer owned by the Lexer
 struct Token {
-    string lexeme;
-    string type;
+    uint32_t offset;    // byte offset of the lexeme in Lexer::text
+    uint32_t length;
+    uint32_t symbol;    // interned id for identifiers and keywords, NO_SYMBOL otherwise
+    TokenKind kind;
+};
+
+// Token resolved against its Lexer, used wherever the text form is needed
+struct TokenView {
+    string_view lexeme;
+    TokenKind kind;
     int rowNum;
     int colNum;
 
+    const char* type(void) const {
+        return tokenKindNames[kind];
+    }
 
-    string stringifyToken(void){
+    string stringifyToken(void) const {
     	// function which returns the token in a string format
-    	return string(lexeme+'\t'+type+'\t'+to_string(rowNum) +'\t' + to_string(colNum)); 
+    	return string(lexeme) + '\t' + type() + '\t' + to_string(rowNum) + '\t' + to_string(colNum);
     }
 };
 
-stack<int> indentLevels;
+// Interned identifier and keyword names, ids are handed out in first-seen order
+struct SymbolInterner {
+    unordered_map<string_view, uint32_t> ids;
+    vector<string_view> names;
+
+    // returns the id of name, adding it if unseen
+    uint32_t intern(string_view name) {
+        auto it = ids.find(name);
+        if (it != ids.end()) return it->second;
+        uint32_t id = names.size();
+        ids.emplace(name, id);
+        names.push_back(name);
+        return id;
+    }
+
+    void clear() {
+        ids.clear();
+        names.clear();
+    }
+};
+
+
+// How the Lexer gets at the source bytes
+enum LexerInput {
+    LEXER_READ,     // read the file into a heap buffer
+    LEXER_MMAP,     // map the file read-only, falls back to reading if it cannot be mapped
+};
 
 
 struct Lexer{
-	// Contains a set of valid keywords for the python like language 
+	// Contains a set of valid keywords for the python like language
 
 	string fileName;
-	set<string> keywords; 
+	set<string> keywords;
 	vector<Token> allTokens;
 
+	// whole input file, every Token points into it
+	// text views either the heap buffer source or the mapped file
+	LexerInput inputMode;
+	string source;
+	void* mapped = nullptr;
+	size_t mappedSize = 0;
+	string_view text;
+	bool opened = false;
+	// why the file could not be lexed (unreadable, inconsistent indentation),
+	// empty while it is fine; next() returns false from the error on
+	string error;
+
+	// streaming state: next unread line, its row, the indentation stack
+	// and the tokens of the current line not handed out yet
+	uint32_t cursor = 0;
+	int rowNum = 0;
+	stack<int> indentLevels;
+	vector<Token> pending;
+	size_t pendingPos = 0;
+	bool flushed = false;
+	// start offset of every line, built on demand for row/col lookups
+	vector<uint32_t> lineStarts;
+	bool lineIndexBuilt = false;
+
+	// interned identifier and keyword names, the keywords take the first ids
+	SymbolInterner symbols;
+	uint32_t numKeywords = 0;
+
 	// Contains a list of pairs of regex and the token type it recognizes
 	// Map not used to successfully match the regex in proper order specified during initialization
-	vector<pair<regex, string>> tokenPatterns;
+	vector<pair<string, TokenKind>> tokenPatterns;
+
+	// all of tokenPatterns compiled into one DFA, longest match wins and ties go to the earlier pattern
+	TokenDFA dfa;
 
-	
-	Lexer(const string &fileName){
+
+	Lexer(const string &fileName, LexerInput inputMode = LEXER_READ){
 		this->fileName = string(fileName);
+		this->inputMode = inputMode;
 
 		keywords = {
 		  	"if", "else", "elif", "int", "bool", "float", "list", "str",
 		};
-		
-		regex stringLiteralRegex(R"('([^'\\]|\\.)*')");
-		regex floatLiteralRegex(R"(\b\d+\.\d+\b)");
-		regex intLiteralRegex(R"(\b\d+\b)");
-		regex boolLiteralRegex(R"(\bTrue\b|\bFalse\b)");
-		regex identifierRegex(R"(\b[a-zA-Z_][a-zA-Z0-9_]*\b)");
-		regex operatorRegex(R"(==|=|<|>)");
-		regex punctuatorRegex(R"([(){}\[\],:.;])");
-		
-		
+		for (const string &kw : keywords) symbols.intern(kw);
+		numKeywords = symbols.names.size();
+
+		string stringLiteralRegex = R"('([^'\\]|\\.)*')";
+		string floatLiteralRegex = R"(\b\d+\.\d+\b)";
+		string intLiteralRegex = R"(\b\d+\b)";
+		string boolLiteralRegex = R"(\bTrue\b|\bFalse\b)";
+		string identifierRegex = R"(\b[a-zA-Z_][a-zA-Z0-9_]*\b)";
+		string operatorRegex = R"(==|=|<|>)";
+		string punctuatorRegex = R"([(){}\[\],:.;])";
+
+
 		// list of regex mapped to its corresponding token type it recognizes in proper order
 		tokenPatterns = {
-		    {stringLiteralRegex, "STRING"},
-		    {floatLiteralRegex, "FLOAT"},
-		    {intLiteralRegex, "INTEGER"},
-		    {boolLiteralRegex, "BOOLEAN"},
-		    {identifierRegex, "IDENTIFIER"},
-		    {operatorRegex, "OPERATOR"},
-		    {punctuatorRegex, "PUNCTUATOR"}
+		    {stringLiteralRegex, TK_STRING},
+		    {floatLiteralRegex, TK_FLOAT},
+		    {intLiteralRegex, TK_INTEGER},
+		    {boolLiteralRegex, TK_BOOLEAN},
+		    {identifierRegex, TK_IDENTIFIER},
+		    {operatorRegex, TK_OPERATOR},
+		    {punctuatorRegex, TK_PUNCTUATOR}
 		};
+
+		vector<string> patterns;
+		for (auto &ele : tokenPatterns) patterns.push_back(ele.first);
+		dfa.build(patterns);
 	}
 
+	~Lexer(){
+		unmapSource();
+	}
+
+	// tokens and the mapping are owned by this lexer
+	Lexer(const Lexer&) = delete;
+	Lexer& operator=(const Lexer&) = delete;
+
 
 	//function to classify if the identifier regex identified a keyword or a regex
-	string classifyKeywordOrIdentifier(const string&);
+	TokenKind classifyKeywordOrIdentifier(uint32_t symbol) const;
 	// function to tokenize the contents of file on a line by line basis
-	vector<Token> tokenizeCurrentLine(string&, int);
+	// identifiers are interned into the given table, the parallel lexer passes a per-chunk one
+	void tokenizeCurrentLine(uint32_t lineStart, uint32_t lineEnd, vector<Token>&, SymbolInterner&) const;
 
-	// function to call for running the lexer 
+	// function to call for running the lexer, collects every token in allTokens
 	void runLexer(void);
 
+	// load the source file and reset the streaming state, false with error set if it cannot be read
+	bool openSource(void);
+	// same for another file, the compiled DFA is kept so one Lexer can go through many files
+	bool open(const string&);
+	bool failed(void) const { return !error.empty(); }
+	bool mapSource(void);
+	void unmapSource(void);
+	// produce the next token, false once the input is exhausted
+	bool next(Token&);
+	// lex the next non-blank line (or the EOF dedents) into pending
+	bool lexNextLine(void);
+	// INDENT/DEDENT tokens for a line starting at lineStart, false with error set on inconsistent dedent
+	bool pushIndentTokens(int, uint32_t, int, vector<Token>&);
+
+	// same tokens as runLexer, lines are tokenized on the pool and stitched back in order,
+	// in chunks of at least PARALLEL_MIN_CHUNK bytes
+	static const uint32_t PARALLEL_MIN_CHUNK = 1 << 16;
+	void runLexerParallel(ThreadPool&);
+	struct Chunk;
+	void lexChunk(Chunk&) const;
+
+	struct iterator;
+	iterator begin(void);
+	iterator end(void);
+
 	// print all the tokens
 	void printLexer(void);
 
-	
+	// row and column of a token, from the line index
+	void position(const Token&, int&, int&);
+	string_view lexeme(const Token&) const;
+	TokenView view(const Token&);
 };
 
 
 
 // function to check if the lexeme recognized by identifier regex is a keyword in the language
-string Lexer::classifyKeywordOrIdentifier(const string& lexeme) {
-    if (keywords.count(lexeme)) return "KEYWORD";
-    return "IDENTIFIER";
-}
-
-vector<Token> Lexer::tokenizeCurrentLine(string& line, int rowNum) {
-    vector<Token> tokens;
-    int i = 0;
-    while (i < (int)line.length()) {
-        if (line[i] == '#') break; // Skip comments in the test code provided
-
-        bool regexMatched = false;
-
-        for (auto  ele : tokenPatterns) {
-        	regex pattern = ele.first;
-        	string type = ele.second;
-            smatch match; // stores the position wrt sub (0-based) where match is found
-            string sub = line.substr(i);
-
-            if (regex_search(sub, match, pattern) && match.position() == 0) {
-                string lexeme = match.str();
-                string finalType = type;
-
-                // if identifier regex is matched successfully then check if the string matched is a keyword or not 
-                if (type == "IDENTIFIER") {
-                    finalType = classifyKeywordOrIdentifier(lexeme);
-                }
-
-				// add the token to the list of tokens identified for this line
-                tokens.push_back({lexeme, finalType, rowNum, i});
-                // jump by number of characters matched 
-                i += lexeme.length();
-                // set regexMached to true indicating the row contains a valid python token
-                regexMatched = true;
-                break;
+TokenKind Lexer::classifyKeywordOrIdentifier(uint32_t symbol) const {
+    if (symbol < numKeywords) return TK_KEYWORD;
+    return TK_IDENTIFIER;
+}
+
+void Lexer::tokenizeCurrentLine(uint32_t lineStart, uint32_t lineEnd, vector<Token>& tokens, SymbolInterner& table) const {
+    const char* data = text.data() + lineStart;
+    size_t n = lineEnd - lineStart;
+    size_t i = 0;
+    uint32_t matches = 0, lookups = 0;
+    while (i < n) {
+        if (data[i] == '#') break; // Skip comments in the test code provided
+
+        int pattern;
+        int len = dfa.match(data, n, i, pattern);
+        matches++;
+
+        if (len > 0) {
+            Token tok = {lineStart + (uint32_t)i, (uint32_t)len, NO_SYMBOL, tokenPatterns[pattern].second};
+
+            // if identifier regex is matched successfully then check if the string matched is a keyword or not
+            if (tok.kind == TK_IDENTIFIER) {
+                tok.symbol = table.intern(string_view(data + i, len));
+                lookups++;
+                tok.kind = classifyKeywordOrIdentifier(tok.symbol);
             }
-        }
 
-        if (!regexMatched) {
+            // add the token to the list of tokens identified for this line
+            tokens.push_back(tok);
+            // jump by number of characters matched
+            i += len;
+        } else {
         	// Simply skip the token that is unrecognized
             i++;
         }
     }
+    stats.add(STAT_DFA_MATCHES, matches);
+    stats.add(STAT_SYMBOL_LOOKUPS, lookups);
+}
+
+
+bool Lexer::mapSource(void){
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return false;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        text = string_view();
+        return true;
+    }
+
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return false;
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
 
-    return tokens;
+    mapped = p;
+    mappedSize = st.st_size;
+    text = string_view((const char*)p, mappedSize);
+    return true;
 }
 
+void Lexer::unmapSource(void){
+    if (mapped) munmap(mapped, mappedSize);
+    mapped = nullptr;
+    mappedSize = 0;
+}
 
-void Lexer::runLexer(void){
-    ifstream file(fileName);
 
-    if (!file.is_open()) {
-        cerr << "Failed to open " << fileName << endl;
-        exit(1);
+bool Lexer::openSource(void){
+    unmapSource();
+    source.clear();
+    text = string_view();
+    error.clear();
+
+    if (inputMode != LEXER_MMAP || !mapSource()) {
+        ifstream file(fileName, ios::binary);
+
+        if (!file.is_open()) {
+            error = "Failed to open " + fileName;
+        } else {
+            source.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+            file.close();
+            text = source;
+        }
     }
 
-    string line;
-    int rowNum = 0;
-    allTokens.clear();
+    if (text.size() >= UINT32_MAX) {
+        error = fileName + " is too large, tokens use 32-bit offsets";
+        unmapSource();
+        source.clear();
+        text = string_view();
+    }
+    lineStarts.clear();
+    lineIndexBuilt = false;
+
+    // names interned from a previous file point into the old buffer
+    symbols.clear();
+    for (const string &kw : keywords) symbols.intern(kw);
+
+    cursor = 0;
+    rowNum = 0;
+    pending.clear();
+    pendingPos = 0;
+    flushed = false;
     indentLevels = stack<int>(); // clear the stack
     indentLevels.push(0); // start with base indentation level 0
+    opened = true;
+    flushed = failed();   // nothing to hand out from a file that could not be read
+    return !failed();
+}
+
+bool Lexer::open(const string& name){
+    fileName = name;
+    return openSource();
+}
+
 
-    while (getline(file, line)) {
-        int actualIndent = 0;
-        for (char c : line) {
-            if (c == ' ') actualIndent++;
-            else if (c == '\t') actualIndent += 4; // assuming a tab = 4 spaces
-            else break;
+bool Lexer::pushIndentTokens(int actualIndent, uint32_t lineStart, int row, vector<Token>& tokens){
+    if (actualIndent > indentLevels.top()) {
+        indentLevels.push(actualIndent);
+        tokens.push_back({lineStart, 0, NO_SYMBOL, TK_INDENT});
+    } else if (actualIndent < indentLevels.top()) {
+        while (!indentLevels.empty() && actualIndent < indentLevels.top()) {
+            indentLevels.pop();
+            tokens.push_back({lineStart, 0, NO_SYMBOL, TK_DEDENT});
         }
+        if (actualIndent != indentLevels.top()) {
+            error = "Indentation error at line " + to_string(row + 1);
+            return false;
+        }
+    }
+    return true;
+}
 
-        string trimmed = line;
-        trimmed.erase(0, trimmed.find_first_not_of(" \t"));
 
-        if (trimmed.empty() || trimmed[0] == '#') {
+bool Lexer::lexNextLine(void){
+    pending.clear();
+    pendingPos = 0;
+    uint32_t size = text.size();
+    const char* base = text.data();
+    const char* end = base + size;
+
+    // same line splitting as getline: a trailing newline does not start another line
+    while (cursor < size) {
+        uint32_t lineStart = cursor;
+
+        // the indent scan stops at the newline by itself, blank and comment-only
+        // lines are recognised from the first byte after it
+        int actualIndent;
+        const char* first = scanKernels.scanIndent(base + lineStart, end, actualIndent);
+        const char* nl = scanKernels.findNewline(first, end);
+        uint32_t lineEnd = nl - base;
+        cursor = lineEnd + 1;
+
+        if (first == nl || *first == '#') {
             rowNum++;
             continue; // skip empty or comment-only lines
         }
 
-        if (actualIndent > indentLevels.top()) {
-            indentLevels.push(actualIndent);
-            allTokens.push_back({"\\t", "INDENT", rowNum, 0});
-        } else if (actualIndent < indentLevels.top()) {
-            while (!indentLevels.empty() && actualIndent < indentLevels.top()) {
-                indentLevels.pop();
-                allTokens.push_back({"\\b", "DEDENT", rowNum, 0});
-            }
-            if (actualIndent != indentLevels.top()) {
-                cerr << "Indentation error at line " << rowNum << endl;
-                exit(1);
-            }
+        if (!pushIndentTokens(actualIndent, lineStart, rowNum, pending)) {
+            // the stream ends at the error, the caller sees it in error
+            pending.clear();
+            cursor = size;
+            flushed = true;
+            return false;
         }
 
-        vector<Token> tokens = tokenizeCurrentLine(line, rowNum);
-        allTokens.insert(allTokens.end(), tokens.begin(), tokens.end());
+        tokenizeCurrentLine(lineStart, lineEnd, pending, symbols);
 
-        allTokens.push_back({"\\n", "NEWLINE", rowNum, (int)(line.length())});
+        pending.push_back({lineEnd, 0, NO_SYMBOL, TK_NEWLINE});
         rowNum++;
+        stats.add(STAT_TOKENS, pending.size());
+        return true;
     }
 
+    if (flushed) return false;
+
     // At EOF, flush remaining indent levels
     while (indentLevels.size() > 1) {
         indentLevels.pop();
-        allTokens.push_back({"\\b", "DEDENT", rowNum, 0});
+        pending.push_back({size, 0, NO_SYMBOL, TK_DEDENT});
+    }
+    flushed = true;
+    stats.add(STAT_TOKENS, pending.size());
+    return true;
+}
+
+
+bool Lexer::next(Token& tok){
+    if (!opened) openSource();
+    while (pendingPos == pending.size()) {
+        if (!lexNextLine()) return false;
+    }
+    tok = pending[pendingPos++];
+    return true;
+}
+
+
+void Lexer::runLexer(void){
+    openSource();
+    allTokens.clear();
+    Token tok;
+    while (next(tok)) allTokens.push_back(tok);
+}
+
+
+// Slice of the source handled by one parallel lexing task, it starts and ends on line boundaries
+struct Lexer::Chunk {
+    struct Line {
+        uint32_t start, end;
+        int row;              // row within the chunk
+        int indent;
+        uint32_t tokenEnd;    // one past the line's last token in tokens
+    };
+
+    uint32_t begin, end;
+    int lineCount = 0;        // every line, blank and comment-only ones included
+    vector<Line> lines;       // lines that produce tokens
+    vector<Token> tokens;     // symbols are ids in local, not in Lexer::symbols
+    SymbolInterner local;
+};
+
+void Lexer::lexChunk(Chunk& chunk) const {
+    // seeded like Lexer::symbols so keyword ids agree
+    for (const string &kw : keywords) chunk.local.intern(kw);
+
+    const char* base = text.data();
+    const char* end = base + chunk.end;
+    uint32_t lineStart = chunk.begin;
+    while (lineStart < chunk.end) {
+        int actualIndent;
+        const char* first = scanKernels.scanIndent(base + lineStart, end, actualIndent);
+        const char* nl = scanKernels.findNewline(first, end);
+        uint32_t lineEnd = nl - base;
+
+        if (first != nl && *first != '#') {
+            tokenizeCurrentLine(lineStart, lineEnd, chunk.tokens, chunk.local);
+            chunk.lines.push_back({lineStart, lineEnd, chunk.lineCount, actualIndent, (uint32_t)chunk.tokens.size()});
+        }
+        chunk.lineCount++;
+        lineStart = lineEnd + 1;
+    }
+}
+
+void Lexer::runLexerParallel(ThreadPool& pool){
+    allTokens.clear();
+    if (!openSource()) return;
+    uint32_t size = text.size();
+    const char* base = text.data();
+
+    // cut the file into a few chunks per worker, moving each cut to the next line start
+    size_t wanted = max<size_t>(1, min<size_t>(pool.size() * 4, size / PARALLEL_MIN_CHUNK));
+    vector<Chunk> chunks;
+    uint32_t begin = 0;
+    for (size_t k = 1; k <= wanted && begin < size; ++k) {
+        uint32_t cut = size;
+        if (k < wanted) {
+            cut = max<uint32_t>(begin, (uint64_t)size * k / wanted);
+            cut = scanKernels.findNewline(base + cut, base + size) - base;
+            cut = min(size, cut + 1);
+        }
+        if (cut <= begin) continue;
+        chunks.emplace_back();
+        chunks.back().begin = begin;
+        chunks.back().end = cut;
+        begin = cut;
+    }
+
+    pool.parallelFor(chunks.size(), [&](size_t c) {
+        PhaseScope phase("lex chunk");
+        lexChunk(chunks[c]);
+    });
+
+    // sequential pass: global symbol ids in first-seen order, indentation tokens, stitching
+    size_t total = 0;
+    for (const Chunk &chunk : chunks) total += chunk.tokens.size() + 2 * chunk.lines.size();
+    allTokens.reserve(total);
+
+    vector<uint32_t> remap;
+    for (Chunk &chunk : chunks) {
+        remap.resize(chunk.local.names.size());
+        for (uint32_t id = 0; id < remap.size(); ++id) remap[id] = symbols.intern(chunk.local.names[id]);
+
+        uint32_t tokenBegin = 0;
+        for (const Chunk::Line &line : chunk.lines) {
+            // on an indentation error keep the tokens before the line, as next() does
+            size_t lineBegin = allTokens.size();
+            if (!pushIndentTokens(line.indent, line.start, rowNum + line.row, allTokens)) {
+                allTokens.resize(lineBegin);
+                rowNum += line.row;     // next() also stops at the failing line
+                break;
+            }
+            for (uint32_t t = tokenBegin; t < line.tokenEnd; ++t) {
+                Token tok = chunk.tokens[t];
+                if (tok.symbol != NO_SYMBOL) tok.symbol = remap[tok.symbol];
+                allTokens.push_back(tok);
+            }
+            allTokens.push_back({line.end, 0, NO_SYMBOL, TK_NEWLINE});
+            tokenBegin = line.tokenEnd;
+        }
+        if (failed()) break;
+        rowNum += chunk.lineCount;
+
+        // release each chunk as soon as it is copied out
+        chunk = Chunk();
+    }
+
+    // At EOF, flush remaining indent levels
+    while (!failed() && indentLevels.size() > 1) {
+        indentLevels.pop();
+        allTokens.push_back({size, 0, NO_SYMBOL, TK_DEDENT});
+    }
+    cursor = size;
+    flushed = true;
+    stats.add(STAT_TOKENS, allTokens.size());
+}
+
+
+// input iterator over the token stream, for (const Token &tok : lexer) pulls tokens lazily
+struct Lexer::iterator {
+    Lexer* lexer;
+    Token tok;
+
+    const Token& operator*() const { return tok; }
+    const Token* operator->() const { return &tok; }
+
+    iterator& operator++() {
+        if (!lexer->next(tok)) lexer = nullptr;
+        return *this;
     }
 
-    file.close();
+    bool operator==(const iterator& other) const { return lexer == other.lexer; }
+    bool operator!=(const iterator& other) const { return lexer != other.lexer; }
+};
+
+Lexer::iterator Lexer::begin(void){
+    iterator it{this, {}};
+    return ++it;
+}
+
+Lexer::iterator Lexer::end(void){
+    return iterator{nullptr, {}};
+}
+
+// tokens lexed up front (runLexerParallel's allTokens) handed out again in
+// order, a token source for BasicLRParser::parseTokens
+struct LexedTokens {
+    const vector<Token> &tokens;
+    size_t pos = 0;
+
+    explicit LexedTokens(const vector<Token> &tokens) : tokens(tokens) {}
+
+    bool next(Token &tok) {
+        if (pos == tokens.size()) return false;
+        tok = tokens[pos++];
+        return true;
+    }
+};
+
+
+void Lexer::position(const Token& tok, int& row, int& col) {
+    if (!lineIndexBuilt) {
+        lineStarts.clear();
+        uint32_t size = text.size();
+        const char* base = text.data();
+        if (size > 0) lineStarts.push_back(0);
+        for (const char* p = base; (p = scanKernels.findNewline(p, base + size)) != base + size; ++p) {
+            uint32_t next = p - base + 1;
+            if (next < size) lineStarts.push_back(next);
+        }
+        lineIndexBuilt = true;
+    }
+
+    // the DEDENTs flushed at EOF sit on the row after the last line
+    if (tok.offset >= text.size() && tok.kind != TK_NEWLINE) {
+        row = lineStarts.size();
+        col = 0;
+        return;
+    }
+    auto it = upper_bound(lineStarts.begin(), lineStarts.end(), tok.offset) - 1;
+    row = it - lineStarts.begin();
+    col = tok.offset - *it;
+}
+
+string_view Lexer::lexeme(const Token& tok) const {
+    if (tok.kind == TK_INDENT) return "\\t";
+    if (tok.kind == TK_DEDENT) return "\\b";
+    if (tok.kind == TK_NEWLINE) return "\\n";
+    return text.substr(tok.offset, tok.length);
+}
+
+TokenView Lexer::view(const Token& tok) {
+    TokenView v;
+    v.lexeme = lexeme(tok);
+    v.kind = tok.kind;
+    position(tok, v.rowNum, v.colNum);
+    return v;
 }
 
 
 void Lexer::printLexer(void){
-	 for (auto token : allTokens) cout << "<" << token.lexeme << ", " << token.type  << ", row: " << token.rowNum << ", col: " << token.colNum << ">" << endl;
-    
+	 for (const Token &tok : allTokens) {
+	 	TokenView token = view(tok);
+	 	cout << "<" << token.lexeme << ", " << token.type()  << ", row: " << token.rowNum << ", col: " << token.colNum << ">" << endl;
+	 }
+
 }
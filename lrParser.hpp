@@ -0,0 +1,277 @@
+
+using namespace std;
+
+// Maps lexer tokens onto grammar terminals. The lexer only knows token kinds
+// (OPERATOR, KEYWORD, ...) while the grammar wants IF, ASSIGN, LEFTPAREN, ...
+// A token is looked up by, in order:
+//  - its name, for keywords and identifiers that are terminals of their own (print → PRINT)
+//  - its lexeme, for operators and punctuators (== → EQUALTO)
+//  - its kind (INTEGER → INTEGER)
+// Rules naming a terminal the grammar does not have are ignored, tokens no
+// rule maps to get -1 and are syntax errors.
+struct TerminalMap {
+    int byKind[TK_COUNT];
+    int byByte[256];                        // one byte operators and punctuators
+    vector<pair<string, int> > byLexeme;    // longer operators and punctuators
+    unordered_map<string, int> byName;      // keywords and identifiers
+    vector<string> terminalNames;           // by terminal id
+
+    // tables are ParseTables or a generated parser's tables, only their terminal names are used
+    template <class Tables>
+    explicit TerminalMap(const Tables &tables) {
+        fill(begin(byKind), end(byKind), -1);
+        fill(begin(byByte), end(byByte), -1);
+        for (int t = 0; t < tables.numTerminals; ++t) terminalNames.push_back(tables.symbolNames[t]);
+    }
+
+    int terminalId(const string &terminal) const {
+        auto it = find(terminalNames.begin(), terminalNames.end(), terminal);
+        return it != terminalNames.end() ? int(it - terminalNames.begin()) : -1;
+    }
+
+    void mapKind(TokenKind kind, const string &terminal) {
+        byKind[kind] = terminalId(terminal);
+    }
+
+    void mapLexeme(const string &lexeme, const string &terminal) {
+        int id = terminalId(terminal);
+        if (lexeme.size() == 1) byByte[(unsigned char)lexeme[0]] = id;
+        else byLexeme.push_back({lexeme, id});
+    }
+
+    void mapName(const string &name, const string &terminal) {
+        byName[name] = terminalId(terminal);
+    }
+
+    // terminal of an interned keyword or identifier, the parser caches it per symbol id
+    int nameTerminal(string_view name, TokenKind kind) const {
+        auto it = byName.find(string(name));
+        return it != byName.end() ? it->second : byKind[kind];
+    }
+
+    int lexemeTerminal(string_view lexeme, TokenKind kind) const {
+        if (lexeme.size() == 1 && byByte[(unsigned char)lexeme[0]] >= 0) return byByte[(unsigned char)lexeme[0]];
+        for (const auto &entry : byLexeme) {
+            if (entry.first == lexeme) return entry.second;
+        }
+        return byKind[kind];
+    }
+
+    // the terminal names grammar.txt uses for the tokens of our lexer
+    template <class Tables>
+    static TerminalMap defaults(const Tables &tables) {
+        TerminalMap map(tables);
+        map.mapKind(TK_IDENTIFIER, "IDENTIFIER");
+        map.mapKind(TK_INTEGER, "INTEGER");
+        map.mapKind(TK_FLOAT, "FLOAT");
+        map.mapKind(TK_STRING, "STRING");
+        map.mapKind(TK_BOOLEAN, "BOOLEAN");
+        map.mapKind(TK_NEWLINE, "NEWLINE");
+        map.mapKind(TK_INDENT, "INDENT");
+        map.mapKind(TK_DEDENT, "DEDENT");
+
+        map.mapName("if", "IF");
+        map.mapName("elif", "ELIF");
+        map.mapName("else", "ELSE");
+        map.mapName("print", "PRINT");
+        map.mapName("input", "INPUT");
+
+        map.mapLexeme("==", "EQUALTO");
+        map.mapLexeme("=", "ASSIGN");
+        map.mapLexeme("<", "LESSTHAN");
+        map.mapLexeme(">", "GREATERTHAN");
+        map.mapLexeme("(", "LEFTPAREN");
+        map.mapLexeme(")", "RIGHTPAREN");
+        map.mapLexeme("[", "LEFTSQUARE");
+        map.mapLexeme("]", "RIGHTSQUARE");
+        map.mapLexeme("{", "LEFTCURLY");
+        map.mapLexeme("}", "RIGHTCURLY");
+        map.mapLexeme(",", "COMMA");
+        map.mapLexeme(":", "COLON");
+        map.mapLexeme(";", "SEMICOLON");
+        map.mapLexeme(".", "DOT");
+        return map;
+    }
+};
+
+
+struct SyntaxError {
+    int row = 0, col = 0;       // 0-based, as Lexer::position gives them
+    string found;               // lexeme of the offending token, "end of input" at EOF
+    vector<string> expected;    // terminals the state had an action for
+    string message;             // the lexer's error instead, when it stopped the token stream
+
+    string toString() const {
+        if (!message.empty()) return message;
+        string res = "Syntax error at line " + to_string(row + 1) + ", column " + to_string(col + 1) + ": unexpected " + found;
+        if (!expected.empty()) {
+            res += ", expected";
+            for (size_t i = 0; i < expected.size(); ++i) res += (i ? " | " : " ") + expected[i];
+        }
+        return res;
+    }
+};
+
+// Table driven LR parser over the tokens of a Lexer. The stacks and the
+// symbol → terminal cache live in the parser and are reused between parses,
+// so the loop itself does not allocate per token.
+//
+// Actions receives the parse as it happens:
+//   void shift(const Token &tok, int terminal);
+//   void reduce(int prod, int length);   // the top length symbols become prodLhs[prod]
+// Tables is ParseTables, or the struct of a generated parser (parserGen.hpp)
+// whose constexpr arrays let the compiler specialize the loop.
+template <class Tables>
+struct BasicLRParser {
+    const Tables &tables;
+    const TerminalMap &terminals;
+    vector<int> stateStack;
+    vector<int> symbolTerminal;     // by interned symbol id, UNRESOLVED until first seen
+    SyntaxError error;
+    size_t tokensParsed = 0;
+
+    static constexpr int UNRESOLVED = -2;
+
+    BasicLRParser(const Tables &tables, const TerminalMap &terminals) : tables(tables), terminals(terminals) {}
+
+    int terminalOf(const Token &tok, const Lexer &lexer) {
+        if (tok.symbol != NO_SYMBOL) {
+            if (tok.symbol >= symbolTerminal.size()) symbolTerminal.resize(2 * tok.symbol + 16, UNRESOLVED);
+            int &t = symbolTerminal[tok.symbol];
+            if (t == UNRESOLVED) t = terminals.nameTerminal(lexer.lexeme(tok), tok.kind);
+            return t;
+        }
+        if (tok.kind == TK_OPERATOR || tok.kind == TK_PUNCTUATOR) return terminals.lexemeTerminal(lexer.lexeme(tok), tok.kind);
+        return terminals.byKind[tok.kind];
+    }
+
+    // parses the rest of lexer's tokens, false with error filled in on a syntax error
+    template <class Actions>
+    bool parse(Lexer &lexer, Actions &actions) {
+        return parseTokens(lexer, lexer, actions);
+    }
+
+    // the same for tokens of lexer's file taken from tokens.next(Token&), a
+    // TokenPipeline's; lexer is only read for lexemes, positions and its error
+    template <class Tokens, class Actions>
+    bool parseTokens(Lexer &lexer, Tokens &tokens, Actions &actions) {
+        PhaseScope phase("parse");
+        // symbol ids restart with every file the lexer opens
+        symbolTerminal.clear();
+        stateStack.clear();
+        stateStack.push_back(0);
+        tokensParsed = 0;
+
+        Token tok;
+        bool more = tokens.next(tok);
+        int a = more ? terminalOf(tok, lexer) : tables.endMarker;
+        while (true) {
+            int32_t act = a >= 0 ? tables.action(stateStack.back(), a) : 0;
+            if (isShift(act)) {
+                actions.shift(tok, a);
+                stateStack.push_back(actionTarget(act));
+                tokensParsed++;
+                more = tokens.next(tok);
+                a = more ? terminalOf(tok, lexer) : tables.endMarker;
+            } else if (isReduce(act)) {
+                int prod = actionTarget(act);
+                if (prod == 0) return !lexicalError(lexer);     // S' → program •, accept
+                int len = tables.prodLength[prod];
+                stateStack.resize(stateStack.size() - len);
+                stateStack.push_back(tables.gotoState(stateStack.back(), tables.prodLhs[prod]));
+                actions.reduce(prod, len);
+            } else {
+                if (!more && lexicalError(lexer)) return false;
+                if (!more) tok = {uint32_t(lexer.text.size()), 0, NO_SYMBOL, TK_DEDENT};
+                reportError(lexer, tok, more);
+                return false;
+            }
+        }
+    }
+
+    // a lexer error ends the token stream early, it is reported instead of what the parser made of it
+    bool lexicalError(const Lexer &lexer) {
+        if (!lexer.failed()) return false;
+        error = SyntaxError();
+        error.message = lexer.error;
+        return true;
+    }
+
+    void reportError(Lexer &lexer, const Token &tok, bool more) {
+        lexer.position(tok, error.row, error.col);
+        if (!more) error.found = "end of input";
+        else if (tok.kind == TK_NEWLINE || tok.kind == TK_INDENT || tok.kind == TK_DEDENT) error.found = tokenKindNames[tok.kind];
+        else error.found = "'" + string(lexer.lexeme(tok)) + "'";
+
+        // with default reductions in play the erroring state has none, so its
+        // explicit entries are exactly the terminals it accepts
+        error.expected.clear();
+        int state = stateStack.back();
+        for (int t = 0; t < tables.numTerminals; ++t) {
+            if (tables.action(state, t) != 0) error.expected.push_back(tables.symbolNames[t]);
+        }
+    }
+};
+
+typedef BasicLRParser<ParseTables> LRParser;
+
+
+// Actions that keep the whole parse tree. Nodes sit in one array, children
+// of a node are a contiguous run of the children array.
+template <class Tables>
+struct BasicParseTree {
+    struct Node {
+        int symbol;             // grammar symbol id
+        int prod;               // production for interior nodes, -1 for leaves
+        uint32_t firstChild;    // into children
+        uint32_t numChildren;
+        Token token;            // leaves only
+    };
+    const Tables &tables;
+    vector<Node> nodes;
+    vector<uint32_t> children;
+    vector<uint32_t> stack;     // nodes of the parser's stack
+
+    BasicParseTree(const Tables &tables) : tables(tables) {}
+
+    void clear() {
+        nodes.clear();
+        children.clear();
+        stack.clear();
+    }
+
+    void shift(const Token &tok, int terminal) {
+        stack.push_back(nodes.size());
+        nodes.push_back({terminal, -1, 0, 0, tok});
+    }
+
+    void reduce(int prod, int length) {
+        Node node = {tables.prodLhs[prod], prod, uint32_t(children.size()), uint32_t(length), {}};
+        children.insert(children.end(), stack.end() - length, stack.end());
+        stack.resize(stack.size() - length);
+        stack.push_back(nodes.size());
+        nodes.push_back(node);
+    }
+
+    // the program node once a parse was accepted
+    uint32_t root() const {
+        return stack.back();
+    }
+
+    // indented dump of the subtree at n, depth first
+    void print(uint32_t n, const Lexer &lexer, ostream &out) const {
+        vector<pair<uint32_t, int> > todo = {{n, 0}};
+        while (!todo.empty()) {
+            uint32_t id = todo.back().first;
+            int depth = todo.back().second;
+            todo.pop_back();
+            const Node &node = nodes[id];
+            out << string(2 * depth, ' ') << tables.symbolNames[node.symbol];
+            if (node.prod < 0 && node.token.length) out << " '" << lexer.lexeme(node.token) << "'";
+            out << "\n";
+            for (uint32_t i = node.numChildren; i-- > 0;) todo.push_back({children[node.firstChild + i], depth + 1});
+        }
+    }
+};
+
+typedef BasicParseTree<ParseTables> ParseTree;
@@ -0,0 +1,304 @@
+
+using namespace std;
+
+// ACTION/GOTO tables generated from an LR collection (canonical or LALR).
+//
+// An action is one int32: 0 is error, v > 0 shifts to state v - 1 and v < 0
+// reduces by production -v - 1. Reducing by production 0 (S' → program) is
+// accept. Both tables are stored as comb vectors (row displacement): row r
+// lives at next[base[r] + column] and owns the slot when check[] holds r.
+// Slots a row does not own fall back to its default, so a lookup is a few
+// array reads:
+//  - ACTION rows are states over terminals, the default is the state's most
+//    common reduction (or error). Like yacc, this can reduce a few times
+//    before an error is seen, but never shifts an erroneous token.
+//  - GOTO rows are nonterminals over states, the default is the most common
+//    target. GOTO is only looked up after a reduction, so it is never wrong.
+
+enum ConflictKind { SHIFT_REDUCE, REDUCE_REDUCE };
+
+// Two actions wanting the same ACTION cell. The table keeps the shift for
+// shift/reduce and the earlier production for reduce/reduce, as yacc does.
+struct LRConflict {
+    ConflictKind kind;
+    int state;
+    int terminal;
+    int32_t kept, dropped;
+    vector<Item> items;     // items of the state behind the two actions
+};
+
+inline int32_t shiftAction(int state) {
+    return state + 1;
+}
+
+inline int32_t reduceAction(int prod) {
+    return -prod - 1;
+}
+
+inline bool isShift(int32_t action) {
+    return action > 0;
+}
+
+inline bool isReduce(int32_t action) {
+    return action < 0;
+}
+
+inline int actionTarget(int32_t action) {
+    return action > 0 ? action - 1 : -action - 1;
+}
+
+// One comb-packed table: rows of sparse (column, value) entries
+struct CombTable {
+    vector<int32_t> base;       // by row
+    vector<int32_t> next;       // values
+    vector<int32_t> check;      // owning row of each slot, -1 if free
+    vector<int32_t> fallback;   // by row, for the slots a row does not own
+
+    // what lookups read: the vectors above once packed, or a mapped table cache
+    const int32_t *baseAt = nullptr, *nextAt = nullptr, *checkAt = nullptr, *fallbackAt = nullptr;
+    size_t rows = 0, slots = 0;
+
+    CombTable() = default;
+    CombTable(const CombTable&) = delete;
+    CombTable& operator=(const CombTable&) = delete;
+
+    int32_t lookup(int row, int column) const {
+        size_t i = size_t(baseAt[row]) + column;
+        return checkAt[i] == row ? nextAt[i] : fallbackAt[row];
+    }
+
+    void view(const int32_t *baseData, const int32_t *fallbackData, const int32_t *nextData, const int32_t *checkData,
+              size_t numRows, size_t numSlots) {
+        baseAt = baseData;
+        fallbackAt = fallbackData;
+        nextAt = nextData;
+        checkAt = checkData;
+        rows = numRows;
+        slots = numSlots;
+    }
+
+    // first fit, densest rows first
+    void pack(const vector<vector<pair<int, int32_t> > > &rows, const vector<int32_t> &defaults, int numColumns) {
+        int numRows = rows.size();
+        base.assign(numRows, 0);
+        fallback = defaults;
+        next.clear();
+        check.clear();
+
+        vector<int> order(numRows);
+        for (int r = 0; r < numRows; ++r) order[r] = r;
+        stable_sort(order.begin(), order.end(), [&](int a, int b) { return rows[a].size() > rows[b].size(); });
+
+        size_t firstFree = 0;   // every slot below is taken
+        for (int r : order) {
+            const vector<pair<int, int32_t> > &row = rows[r];
+            if (row.empty()) continue;
+            int low = row.front().first;
+            size_t start = firstFree > size_t(low) ? firstFree - low : 0;
+            for (size_t b = start; ; ++b) {
+                bool fits = true;
+                for (const auto &entry : row) {
+                    size_t i = b + entry.first;
+                    if (i < check.size() && check[i] >= 0) {
+                        fits = false;
+                        break;
+                    }
+                }
+                if (!fits) continue;
+                base[r] = b;
+                break;
+            }
+            for (const auto &entry : row) {
+                size_t i = base[r] + entry.first;
+                if (i >= check.size()) {
+                    check.resize(i + 1, -1);
+                    next.resize(i + 1, 0);
+                }
+                check[i] = r;
+                next[i] = entry.second;
+            }
+            while (firstFree < check.size() && check[firstFree] >= 0) firstFree++;
+        }
+
+        // lookups may index any column past a row's base
+        size_t end = check.size();
+        for (int r = 0; r < numRows; ++r) end = max(end, size_t(base[r]) + numColumns);
+        check.resize(end, -1);
+        next.resize(end, 0);
+        view(base.data(), fallback.data(), next.data(), check.data(), numRows, end);
+    }
+
+    size_t bytes() const {
+        return (2 * rows + 2 * slots) * sizeof(int32_t);
+    }
+};
+
+struct ParseTables {
+    int numStates = 0;
+    int numTerminals = 0;
+    int numNonTerminals = 0;
+    int endMarker = 0;
+    CombTable actions;     // rows: states, columns: terminal ids
+    CombTable gotos;       // rows: nonterminal index, columns: states, values: target states
+    vector<int> prodLhs;        // nonterminal symbol id of each production
+    vector<int> prodLength;     // rhs length of each production
+    vector<string> symbolNames; // by symbol id, terminals first
+    vector<LRConflict> conflicts;   // only for tables built here, not for loaded ones
+
+    // set when the tables were loaded from a cache file, the combs point into it
+    void *mapped = nullptr;
+    size_t mappedSize = 0;
+
+    ParseTables() = default;
+    ParseTables(const ParseTables&) = delete;
+    ParseTables& operator=(const ParseTables&) = delete;
+
+    ~ParseTables() {
+        if (mapped) munmap(mapped, mappedSize);
+    }
+
+    // id of a symbol by name, -1 if the grammar has no such symbol
+    int symbolId(const string &name) const {
+        for (size_t i = 0; i < symbolNames.size(); ++i) {
+            if (symbolNames[i] == name) return i;
+        }
+        return -1;
+    }
+
+    bool isTerminalId(int id) const {
+        return id < numTerminals;
+    }
+
+    int32_t action(int state, int terminal) const {
+        return actions.lookup(state, terminal);
+    }
+
+    // state after reducing to nonterminal symbol id A in state
+    int gotoState(int state, int A) const {
+        return gotos.lookup(A - numTerminals, state);
+    }
+
+    void build(const vector<DFA_State> &states, const CFG &grammar) {
+        PhaseScope phase("parse tables");
+        numStates = states.size();
+        numTerminals = grammar.numTerminals;
+        numNonTerminals = grammar.numSymbols - grammar.numTerminals;
+        endMarker = grammar.endMarker;
+        symbolNames = grammar.symbolNames;
+        prodLhs = grammar.prodLhs;
+        prodLength.resize(grammar.numProductions());
+        for (int p = 0; p < grammar.numProductions(); ++p) prodLength[p] = grammar.rhsLength(p);
+        conflicts.clear();
+
+        vector<vector<pair<int, int32_t> > > actionRows(numStates), gotoRows(numNonTerminals);
+        vector<int32_t> defaultReduce(numStates, 0), defaultGoto(numNonTerminals, -1);
+        vector<int32_t> row(numTerminals);
+        ClosureCache cache(grammar);
+
+        for (const DFA_State &state : states) {
+            const ItemSet &items = cache.get(state);
+            fill(row.begin(), row.end(), 0);
+
+            // shifts and gotos straight from the transitions
+            for (const auto &edge : state.edges) {
+                if (grammar.isTerminalId(edge.first)) row[edge.first] = shiftAction(edge.second);
+                else gotoRows[edge.first - numTerminals].push_back({state.id, edge.second});
+            }
+
+            // reductions from the completed items
+            for (Item it : items.items) {
+                if (itemNextSymbol(it, grammar) >= 0) continue;
+                int a = itemLookahead(it);
+                int32_t reduce = reduceAction(itemProd(it));
+                int32_t &cell = row[a];
+                if (cell == 0 || cell == reduce) {
+                    cell = reduce;
+                    continue;
+                }
+                LRConflict conflict;
+                conflict.kind = isShift(cell) ? SHIFT_REDUCE : REDUCE_REDUCE;
+                conflict.state = state.id;
+                conflict.terminal = a;
+                if (isShift(cell) || actionTarget(cell) < itemProd(it)) {
+                    conflict.kept = cell;
+                    conflict.dropped = reduce;
+                } else {
+                    conflict.kept = reduce;
+                    conflict.dropped = cell;
+                    cell = reduce;
+                }
+                conflict.items = conflictItems(items, conflict, grammar);
+                conflicts.push_back(conflict);
+            }
+
+            // the most common reduction becomes the default, accept never does
+            unordered_map<int32_t, int> counts;
+            int best = 0;
+            for (int32_t act : row) {
+                if (!isReduce(act) || act == reduceAction(0)) continue;
+                int c = ++counts[act];
+                if (c > best || (c == best && act > defaultReduce[state.id])) {
+                    best = c;
+                    defaultReduce[state.id] = act;
+                }
+            }
+            for (int a = 0; a < numTerminals; ++a) {
+                if (row[a] != 0 && row[a] != defaultReduce[state.id]) actionRows[state.id].push_back({a, row[a]});
+            }
+        }
+
+        // gotos: the most common target becomes the default
+        for (int A = 0; A < numNonTerminals; ++A) {
+            unordered_map<int32_t, int> counts;
+            int best = 0;
+            for (const auto &entry : gotoRows[A]) {
+                int c = ++counts[entry.second];
+                if (c > best || (c == best && entry.second < defaultGoto[A])) {
+                    best = c;
+                    defaultGoto[A] = entry.second;
+                }
+            }
+            vector<pair<int, int32_t> > kept;
+            for (const auto &entry : gotoRows[A]) {
+                if (entry.second != defaultGoto[A]) kept.push_back(entry);
+            }
+            gotoRows[A].swap(kept);
+        }
+
+        actions.pack(actionRows, defaultReduce, numTerminals);
+        gotos.pack(gotoRows, defaultGoto, numStates);
+    }
+
+    // the items of a state that produce the two actions of a conflict
+    static vector<Item> conflictItems(const ItemSet &items, const LRConflict &conflict, const CFG &grammar) {
+        vector<Item> result;
+        for (Item it : items.items) {
+            int next = itemNextSymbol(it, grammar);
+            bool complete = next < 0 && itemLookahead(it) == conflict.terminal;
+            for (int32_t act : {conflict.kept, conflict.dropped}) {
+                if (isShift(act) ? next == conflict.terminal : complete && itemProd(it) == actionTarget(act)) {
+                    result.push_back(it);
+                    break;
+                }
+            }
+        }
+        return result;
+    }
+
+    void reportConflicts(const CFG &grammar, ostream &out) const {
+        for (const LRConflict &c : conflicts) {
+            out << (c.kind == SHIFT_REDUCE ? "shift/reduce" : "reduce/reduce") << " conflict in state " << c.state
+                << " on " << grammar.symbolNames[c.terminal] << ", keeping "
+                << (isShift(c.kept) ? "shift" : "reduce by " + to_string(actionTarget(c.kept))) << ":\n";
+            for (Item it : c.items) out << "  " << itemToString(it, grammar) << "\n";
+        }
+    }
+
+    // sizes of the packed tables next to what dense tables would take
+    void reportSize(ostream &out) const {
+        size_t dense = (size_t(numStates) * (numTerminals + numNonTerminals)) * sizeof(int32_t);
+        out << "parse tables: " << numStates << " states, ACTION comb " << actions.slots << " slots, GOTO comb "
+            << gotos.slots << " slots, " << actions.bytes() + gotos.bytes() << " bytes (dense " << dense
+            << "), " << conflicts.size() << " conflicts\n";
+    }
+};
@@ -1,67 +1,338 @@
 #include <bits/stdc++.h>
 
+#include "tokenDFA.hpp"
+#include "scanKernels.hpp"
+#include "threadPool.hpp"
+#include "stats.hpp"
 #include "lexer.hpp"
 #include "symbolTable.hpp"
+#include "tokenPipeline.hpp"
 #include "CFG.hpp"
 #include "parser.hpp"
+#include "lalr.hpp"
+#include "lrTable.hpp"
+#include "lrParser.hpp"
+#include "ast.hpp"
+#include "bytecode.hpp"
+#include "jit.hpp"
+#include "interpreter.hpp"
+#include "optimizer.hpp"
+#include "tableCache.hpp"
+#include "parserGen.hpp"
+#include "generatedParser.hpp"
+#include "batch.hpp"
 
-int main(){
-	Lexer lexer("test.py");
-	lexer.runLexer();
-	// lexer.printLexer();
-	vector<Token> tokens = lexer.allTokens;
-	
-	cout << "---------------------------------\n";
-	
-	CFG grammar("grammar.txt");
-	grammar.computeAllFirsts();
-	grammar.computeAllFollows();
-	SymbolTable symTable;
-	
-	for (const Token& tok : lexer.allTokens) {
-	    if (tok.type == "IDENTIFIER") {
-	        symTable.addSymbol(tok);  // Only add identifiers
-	    }
-	
+// what to do with test.py once it is parsed
+struct SourceOptions {
+	bool printTree = false, printAst = false, printBytecode = false, run = false, optimize = false, jit = false;
+};
+
+// parses the lexer's file from the start with tables, ParseTables or the generated ones,
+// into the AST, or into the full parse tree for --tree; then lowers and runs it.
+// The tokens come from a pipeline's lexer thread, from lexed when the
+// parallel lexer already made them, or else from the lexer as the parser
+// pulls them; either way the file is lexed once, and the parse fills in the
+// symbol table written here.
+template <class Tables>
+int parseSource(const Tables &tables, Lexer &lexer, const SourceOptions &options, TokenPipeline *pipeline = nullptr,
+                const vector<Token> *lexed = nullptr) {
+	TerminalMap terminalMap = TerminalMap::defaults(tables);
+	BasicLRParser<Tables> parser(tables, terminalMap);
+	BasicParseTree<Tables> tree(tables);
+	AstBuilder<Tables> builder(tables, lexer);
+	SymbolTable symbols;
+	auto parseFrom = [&](auto &tokens) {
+		return options.printTree ? parser.parseTokens(lexer, tokens, tree) : parser.parseTokens(lexer, tokens, builder);
+	};
+	auto parseStart = chrono::steady_clock::now();
+	bool parsed, lexedAll;
+	// the whole file is lexed either way, and a lexical error anywhere in it
+	// is reported over a syntax error
+	if (pipeline) {
+		parsed = parseFrom(*pipeline);
+		lexedAll = pipeline->finish();
+	} else if (lexed) {
+		LexedTokens tokens(*lexed);
+		SymbolFeed<LexedTokens> feed(tokens, lexer, symbols);
+		parsed = parseFrom(feed);
+		lexedAll = feed.drain();
+	} else {
+		lexer.openSource();
+		SymbolFeed<Lexer> feed(lexer, lexer, symbols);
+		parsed = parseFrom(feed);
+		lexedAll = feed.drain();
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - parseStart).count();
+	if (!lexedAll) {
+		cerr << lexer.error << endl;
+		return 1;
+	}
+	(pipeline ? pipeline->symbols : symbols).writeToFile("symboltable.txt");
+	if (pipeline) pipeline->report(cout);
+	if (!parsed || !builder.error.empty()) {
+		cerr << (parsed ? builder.error : parser.error.toString()) << endl;
+		return 1;
+	}
+	cout << "parsed " << parser.tokensParsed << " tokens in " << seconds * 1000 << " ms ("
+	     << (seconds > 0 ? parser.tokensParsed / seconds : 0) << " tokens/s)" << endl;
+	if (options.printTree) {
+		tree.print(tree.root(), lexer, cout);
+		return 0;
 	}
-	symTable.writeToFile("symboltable.txt");
-	// cout << "TERMINALS : ";
-	// for(auto it : grammar.terminals){
-	// 	cout << it << " ";
-	// }
-	// cout << endl;
-	// cout << "---------------------------------\n";
-	// cout << "NONTERMINALS : ";
-	// for(auto it : grammar.nonTerminals){
-	// 	if(it == "S'") continue;
-	// 	cout << it << " ";
-	// }
-	// cout << endl;
-	for (auto &entry : grammar.follow) {
-		if(entry.first == "S'") continue;
-	    cout << "FOLLOW(" << entry.first << ") = { ";
-	    for (const string &val : entry.second) {
-	        cout << val << " ";
-	    }
-	    cout << "}" << endl;
+	builder.ast.reportSize(lexer.rowNum, cout);
+	if (options.optimize) {
+		OptimizerStats optimizerStats;
+		optimizeAst(builder.ast, optimizerStats);
+		optimizerStats.report(cout);
 	}
+	if (options.printAst) builder.ast.print(builder.ast.root, cout);
+	if (!options.printBytecode && !options.run) return 0;
 
-	cout << "---------------------------------\n";
+	BytecodeModule module;
+	string error;
+	if (!compileToBytecode(builder.ast, module, error)) {
+		cerr << error << endl;
+		return 1;
+	}
+	if (options.printBytecode) module.disassemble(cout);
+	if (!options.run) return 0;
+	cout << "---------------------------------" << endl;
+	Interpreter interpreter(module, cin, cout);
+	string why;
+	if (options.jit && !interpreter.compileNative(why)) cerr << "jit: " << why << ", interpreting instead" << endl;
+	if (!interpreter.run()) {
+		cerr << interpreter.error << endl;
+		return 1;
+	}
+	return 0;
+}
 
+// compiles, and with --run executes, every input file on pool with the shared tables
+template <class Tables>
+int compileFiles(const Tables &tables, const vector<string> &files, ThreadPool &pool, const SourceOptions &source) {
+	PhaseScope phase("batch");
+	BatchOptions options;
+	options.run = source.run;
+	options.optimize = source.optimize;
+	options.jit = source.jit;
+	auto start = chrono::steady_clock::now();
+	vector<BatchFileResult> results = compileBatch(tables, files, pool, options);
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	return reportBatch(results, seconds, pool.size(), cout) ? 1 : 0;
+}
 
-	for(auto &entry : grammar.first){
-		if(entry.first == "S'") continue;
-		 cout << "FIRST(" << entry.first << ") = { ";
-	    for (const string &val : entry.second) {
-	        cout << val << " ";
-	    }
-	    cout << "}" << endl;
+// writes the --stats summary and the --trace timeline when main returns
+struct StatsOutput {
+	string summaryPath, tracePath;
+
+	~StatsOutput() {
+		if (!summaryPath.empty()) {
+			ofstream out(summaryPath);
+			if (out) stats.writeSummary(out);
+			else cerr << "Error: Could not open file " << summaryPath << " for writing." << endl;
+		}
+		if (!tracePath.empty()) {
+			ofstream out(tracePath);
+			if (out) stats.writeTrace(out);
+			else cerr << "Error: Could not open file " << tracePath << " for writing." << endl;
+		}
+	}
+};
+
+int main(int argc, char **argv){
+	// --lalr builds LALR(1) states instead of canonical LR(1), --tree prints the parse tree,
+	// --ast prints the abstract syntax tree, --bytecode its bytecode, --run executes test.py,
+	// --optimize runs constant propagation, branch folding and dead store elimination first,
+	// --jit runs it as x86-64 native code, falling back to the interpreter where it cannot,
+	// --pipeline lexes test.py on a thread of its own while the tables load, streaming
+	// the tokens to the parser instead of lexing them as it pulls them,
+	// --rebuild ignores the table cache next to grammar.txt and the generated parser,
+	// --emit-parser [file] writes the tables out as a parser header (generatedParser.hpp),
+	// --verify-parser checks the compiled in generated parser against the runtime tables,
+	// --jobs N builds the canonical collection on N threads, and lexes a test.py larger
+	// than one chunk on them,
+	// files named on the command line or listed in --manifest FILE are compiled
+	// as one batch instead of test.py, on --jobs threads (all cores by default),
+	// with --run each one is executed too, its output going to <file>.out,
+	// --stats [file] writes time, CPU and counters per phase as JSON (stats.json), and the bytes
+	// allocated in a build with -DSTATS_ALLOCATIONS,
+	// --trace [file] writes the phases as a Chrome trace timeline (trace.json)
+	StatsOutput statsOutput;
+	LRBuildOptions lrOptions;
+	SourceOptions sourceOptions;
+	bool rebuild = false, verifyGenerated = false, pipelined = false;
+	string emitPath;
+	unsigned jobs = 0;
+	vector<string> inputs;
+	for (int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		if (arg[0] != '-') inputs.push_back(arg);
+		if (arg == "--manifest") {
+			if (i + 1 == argc) {
+				cerr << "Error: --manifest needs a file name" << endl;
+				return 1;
+			}
+			if (!readManifest(argv[++i], inputs)) {
+				cerr << "Error: Could not read manifest " << argv[i] << endl;
+				return 1;
+			}
+		}
+		if (arg == "--lalr") lrOptions.mode = LR_LALR;
+		if (arg == "--tree") sourceOptions.printTree = true;
+		if (arg == "--ast") sourceOptions.printAst = true;
+		if (arg == "--bytecode") sourceOptions.printBytecode = true;
+		if (arg == "--run") sourceOptions.run = true;
+		if (arg == "--optimize") sourceOptions.optimize = true;
+		if (arg == "--jit") sourceOptions.jit = true;
+		if (arg == "--rebuild") rebuild = true;
+		if (arg == "--pipeline") pipelined = true;
+		if (arg == "--verify-parser") verifyGenerated = true;
+		if (arg == "--jobs") {
+			string_view value = i + 1 < argc ? argv[++i] : "";
+			auto parsed = from_chars(value.data(), value.data() + value.size(), jobs);
+			if (parsed.ec != errc() || parsed.ptr != value.data() + value.size() || jobs == 0) {
+				cerr << "Error: --jobs needs a thread count of 1 or more, not '" << value << "'" << endl;
+				return 1;
+			}
+		}
+		if (arg == "--emit-parser") {
+			emitPath = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : "generatedParser.hpp";
+		}
+		if (arg == "--stats") {
+			statsOutput.summaryPath = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : "stats.json";
+		}
+		if (arg == "--trace") {
+			statsOutput.tracePath = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : "trace.json";
+		}
 	}
 
-	cout << "---------------------------------\n";
-	
+	if (!statsOutput.summaryPath.empty() || !statsOutput.tracePath.empty()) stats.enable();
+
+	bool batch = !inputs.empty();
+	// one pool for the batch, for lexing a large test.py and for building the tables
+	unique_ptr<ThreadPool> pool;
+	if (batch || jobs > 1) pool.reset(new ThreadPool(jobs));
 
+	Lexer lexer("test.py", LEXER_MMAP);
+	unique_ptr<TokenPipeline> pipeline;
+	const vector<Token> *lexed = nullptr;
+	if (!batch && pipelined) {
+		pipeline.reset(new TokenPipeline(lexer));
+	} else if (!batch) {
+		cout << "---------------------------------\n";
+		if (pool && pool->size() > 1) {
+			PhaseScope phase("lex in parallel");
+			// more than one chunk: lex it on the pool, once, and parse the tokens it made
+			lexer.openSource();
+			if (lexer.text.size() > Lexer::PARALLEL_MIN_CHUNK) {
+				lexer.runLexerParallel(*pool);
+				lexed = &lexer.allTokens;
+			}
+		}
+	}
+
+	uint64_t grammarHash;
+	if (!grammarFileHash("grammar.txt", grammarHash)) {
+		cerr << "Error: Could not read grammar.txt" << endl;
+		return 1;
+	}
+
+	// the generated parser needs no tables at all while grammar.txt is unchanged
+	bool generatedCurrent = GeneratedParseTables::grammarHash == grammarHash && GeneratedParseTables::mode == lrOptions.mode;
+	if (generatedCurrent && !rebuild && emitPath.empty() && !verifyGenerated) {
+		cout << "using the generated parser" << endl;
+		if (batch) return compileFiles(GeneratedParseTables(), inputs, *pool, sourceOptions);
+		return parseSource(GeneratedParseTables(), lexer, sourceOptions, pipeline.get(), lexed);
+	}
+	if (!generatedCurrent) cout << "generatedParser.hpp is for another grammar or mode, refresh it with --emit-parser" << endl;
+
+	string cachePath = tableCachePath("grammar.txt", lrOptions.mode);
+	string why = "rebuild requested";
+	ParseTables tables;
+	if (!rebuild && loadParseTables(tables, cachePath, grammarHash, lrOptions.mode, why)) {
+		cout << "parse tables loaded from " << cachePath << endl;
+	} else {
+		cout << "building parse tables: " << why << endl;
+
+		CFG grammar("grammar.txt");
+		grammar.computeAllFirsts();
+		grammar.computeAllFollows();
+		// cout << "TERMINALS : ";
+		// for(auto it : grammar.terminals){
+		// 	cout << it << " ";
+		// }
+		// cout << endl;
+		// cout << "---------------------------------\n";
+		// cout << "NONTERMINALS : ";
+		// for(auto it : grammar.nonTerminals){
+		// 	if(it == "S'") continue;
+		// 	cout << it << " ";
+		// }
+		// cout << endl;
+		for (auto &entry : grammar.follow) {
+			if(entry.first == "S'") continue;
+		    cout << "FOLLOW(" << entry.first << ") = { ";
+		    for (const string &val : entry.second) {
+		        cout << val << " ";
+		    }
+		    cout << "}" << endl;
+		}
+
+		cout << "---------------------------------\n";
+
+
+		for(auto &entry : grammar.first){
+			if(entry.first == "S'") continue;
+			 cout << "FIRST(" << entry.first << ") = { ";
+		    for (const string &val : entry.second) {
+		        cout << val << " ";
+		    }
+		    cout << "}" << endl;
+		}
+
+		cout << "---------------------------------\n";
+
+		ClosureEngine closureEngine(grammar);
+		lrOptions.engine = &closureEngine;
+		if (pool && pool->size() > 1) lrOptions.pool = pool.get();
+		vector<DFA_State> dfa_states = buildLRCollection(grammar, lrOptions);
+		if (lrOptions.mode == LR_LALR) {
+			reportLALRMerge(buildCanonicalCollection(grammar, lrOptions), dfa_states, grammar, cout);
+		} else {
+			cout << "LR(1) states: " << dfa_states.size() << endl;
+		}
+		closureEngine.report(cout);
+		//printDFAStates(dfa_states, grammar);
+
+		tables.build(dfa_states, grammar);
+		tables.reportConflicts(grammar, cerr);
+		if (!saveParseTables(tables, cachePath, grammarHash, lrOptions.mode)) {
+			cerr << "Error: Could not write " << cachePath << endl;
+		}
+	}
+	tables.reportSize(cout);
+
+	if (!emitPath.empty()) {
+		ofstream out(emitPath);
+		if (!out) {
+			cerr << "Error: Could not open file " << emitPath << " for writing." << endl;
+			return 1;
+		}
+		emitParserHeader(tables, grammarHash, lrOptions.mode, "grammar.txt", out);
+		cout << "wrote " << emitPath << endl;
+		return 0;
+	}
+	if (verifyGenerated) {
+		if (!generatedCurrent) {
+			cerr << "generatedParser.hpp was generated from another grammar or mode" << endl;
+			return 1;
+		}
+		bool same = sameParseTables(tables, GeneratedParseTables(), cerr);
+		cout << "generated parser " << (same ? "matches" : "DOES NOT match") << " the runtime tables" << endl;
+		return same ? 0 : 1;
+	}
 
-	vector<DFA_State> dfa_states = buildCanonicalCollection(grammar);
-	//printDFAStates(dfa_states);
+	if (batch) return compileFiles(tables, inputs, *pool, sourceOptions);
+	// second pass over test.py, this time through the parser
+	return parseSource(tables, lexer, sourceOptions, pipeline.get(), lexed);
 }
@@ -0,0 +1,371 @@
+
+using namespace std;
+
+// Optimization passes over the AST, run before it is lowered to bytecode.
+// The language has no loops, so every if/elif/else is a forward branch that
+// joins again at its end, and the passes walk the tree in program order
+// instead of iterating a dataflow over a control flow graph.
+//
+//  - constant propagation: what every variable holds is tracked along the
+//    program, a known constant replaces the variable wherever it is read.
+//    Each arm of an if starts from the state before it and the arms are
+//    merged at its end (the φ of SSA form): a variable keeps its constant
+//    only if every arm that can run leaves it the same. The arms' changes
+//    are kept in an undo log, so an if costs what its arms assign, not the
+//    number of variables.
+//  - comparison folding: a comparison of two constants is decided with the
+//    interpreter's semantics, except where it would raise a TypeError.
+//  - dead branch elimination: arms whose test is false go, an arm whose
+//    test is true becomes the else and the arms after it go, an if left
+//    with only an else is replaced by that else's statements.
+//  - dead store elimination: backwards, an assignment to a variable no
+//    later statement reads goes, unless reading its source could raise a
+//    NameError.
+
+// what every pass changed; the first three share the forward walk
+struct OptimizerStats {
+    size_t propagated = 0;      // variable reads replaced by a constant
+    size_t folded = 0;          // comparisons decided
+    size_t armsRemoved = 0;     // if/elif/else arms that can never run
+    size_t ifsFlattened = 0;    // ifs replaced by the statements of their one arm left
+    size_t deadStores = 0;      // assignments removed
+    size_t statementsBefore = 0, statementsAfter = 0;
+    double forwardSeconds = 0, backwardSeconds = 0;
+
+    void report(ostream &out) const {
+        out << "optimizer: " << statementsBefore << " statements, " << statementsAfter << " left\n"
+            << "  constant propagation     " << setw(8) << propagated << " reads replaced\n"
+            << "  comparison folding       " << setw(8) << folded << " comparisons decided\n"
+            << "  dead branch elimination  " << setw(8) << armsRemoved << " arms removed, "
+            << ifsFlattened << " ifs flattened\n"
+            << "  dead store elimination   " << setw(8) << deadStores << " assignments removed\n"
+            << "  forward walk " << forwardSeconds * 1000 << " ms, backward walk " << backwardSeconds * 1000
+            << " ms" << endl;
+    }
+};
+
+// a set of variables by name id
+struct LiveSet {
+    vector<uint64_t> words;
+
+    explicit LiveSet(size_t n) : words((n + 63) / 64, 0) {}
+
+    bool test(uint32_t v) const {
+        return words[v >> 6] >> (v & 63) & 1;
+    }
+
+    void set(uint32_t v, bool on) {
+        if (on) words[v >> 6] |= uint64_t(1) << (v & 63);
+        else words[v >> 6] &= ~(uint64_t(1) << (v & 63));
+    }
+
+    void unite(const LiveSet &other) {
+        for (size_t i = 0; i < words.size(); ++i) words[i] |= other.words[i];
+    }
+};
+
+class Optimizer {
+private:
+    Ast &ast;
+    OptimizerStats &stats;
+
+    // what a variable holds: a literal node, or one of these
+    static constexpr uint32_t UNDEFINED = UINT32_MAX;       // on every path so far
+    static constexpr uint32_t MAYBE_UNDEFINED = UINT32_MAX - 1;
+    static constexpr uint32_t UNKNOWN = UINT32_MAX - 2;     // defined, value not known
+
+    vector<uint32_t> state;                     // by name id
+    vector<pair<uint32_t, uint32_t> > undo;     // (variable, previous state)
+    vector<uint8_t> mayFail;                    // by node, assignments whose source may be undefined
+    BytecodeModule scratch;                     // Values of the literals being compared
+
+    static bool isLiteral(uint32_t v) {
+        return v < UNKNOWN;
+    }
+
+    void set(uint32_t var, uint32_t v) {
+        undo.push_back({var, state[var]});
+        state[var] = v;
+    }
+
+    void rollback(size_t mark) {
+        while (undo.size() > mark) {
+            state[undo.back().first] = undo.back().second;
+            undo.pop_back();
+        }
+    }
+
+    // same value and type, lists only when they are the same node
+    bool sameLiteral(uint32_t x, uint32_t y) const {
+        if (x == y) return true;
+        const AstNode &a = ast[x], &b = ast[y];
+        if (a.kind != b.kind || a.kind == AST_LIST) return false;
+        if (a.kind == AST_STRING) return ast.stringValue(a) == ast.stringValue(b);
+        return a.a == b.a && a.b == b.b;
+    }
+
+    // the φ of two states of one variable
+    uint32_t meet(uint32_t x, uint32_t y) const {
+        if (x == y) return x;
+        if (x == UNDEFINED || x == MAYBE_UNDEFINED || y == UNDEFINED || y == MAYBE_UNDEFINED) return MAYBE_UNDEFINED;
+        if (isLiteral(x) && isLiteral(y) && sameLiteral(x, y)) return x;
+        return UNKNOWN;
+    }
+
+    // n with a variable read replaced by its constant
+    uint32_t propagate(uint32_t n) {
+        if (ast[n].kind != AST_NAME || !isLiteral(state[ast[n].a])) return n;
+        stats.propagated++;
+        return state[ast[n].a];
+    }
+
+    // true when the comparison is decided, its outcome in holds
+    bool fold(uint32_t n, bool &holds) {
+        AstNode &cmp = ast.nodes[n];
+        uint32_t a = cmp.a, b = cmp.b;
+        cmp.a = propagate(cmp.a);
+        cmp.b = propagate(cmp.b);
+        if (ast[cmp.a].kind == AST_NAME || ast[cmp.b].kind == AST_NAME) return false;
+        scratch.strings.clear();
+        scratch.listItems.clear();
+        Value x = scratch.literalValue(ast, cmp.a), y = scratch.literalValue(ast, cmp.b);
+        string typeError;
+        int result = cmp.op == AST_EQUAL ? scratch.equal(x, y)
+                   : scratch.ordered(x, y, cmp.op == AST_LESS, astOpNames[cmp.op], typeError);
+        if (result < 0) {
+            // left for the interpreter to raise, on the line of its variables
+            stats.propagated -= (cmp.a != a) + (cmp.b != b);
+            cmp.a = a;
+            cmp.b = b;
+            return false;
+        }
+        holds = result;
+        stats.folded++;
+        return true;
+    }
+
+    // the variables an arm assigned and what they hold at its end
+    typedef vector<pair<uint32_t, uint32_t> > ArmState;
+
+    ArmState armState(size_t mark) const {
+        ArmState res;
+        for (size_t i = mark; i < undo.size(); ++i) res.push_back({undo[i].first, state[undo[i].first]});
+        return res;
+    }
+
+    // Propagates through an if, folds its tests and drops the arms that
+    // cannot run. Returns false when no arm is left.
+    bool forwardIf(uint32_t n) {
+        AstNode &node = ast.nodes[n];
+        vector<uint32_t> arms;
+        vector<ArmState> armStates;
+        bool exhaustive = false;
+        uint32_t before = node.b;
+        for (uint32_t br = node.a; br != AST_NONE && !exhaustive; br = ast[br].next) {
+            AstNode &branch = ast.nodes[br];
+            if (branch.a != AST_NONE) {
+                bool holds;
+                if (fold(branch.a, holds)) {
+                    if (!holds) continue;
+                    branch.a = AST_NONE;    // always taken, the arms after it never run
+                }
+            }
+            exhaustive = branch.a == AST_NONE;
+            size_t mark = undo.size();
+            forwardBlock(branch.b);
+            armStates.push_back(armState(mark));
+            rollback(mark);
+            arms.push_back(br);
+        }
+        stats.armsRemoved += before - arms.size();
+
+        // φ: a variable an arm assigned meets what every other arm, or
+        // falling through without an else, leaves it
+        if (!exhaustive) armStates.push_back(ArmState());
+        struct Phi {
+            uint32_t value;
+            size_t arms;
+            size_t lastArm;
+        };
+        unordered_map<uint32_t, Phi> phis;
+        for (size_t i = 0; i < armStates.size(); ++i) {
+            for (const auto &assigned : armStates[i]) {
+                Phi &phi = phis.try_emplace(assigned.first, Phi{assigned.second, 0, SIZE_MAX}).first->second;
+                if (phi.lastArm == i) continue;
+                phi.value = phi.arms ? meet(phi.value, assigned.second) : assigned.second;
+                phi.arms++;
+                phi.lastArm = i;
+            }
+        }
+        for (auto &var : phis) {
+            Phi &phi = var.second;
+            if (phi.arms < armStates.size()) phi.value = meet(phi.value, state[var.first]);
+            set(var.first, phi.value);
+        }
+
+        for (size_t i = 0; i < arms.size(); ++i) ast.nodes[arms[i]].next = i + 1 < arms.size() ? arms[i + 1] : AST_NONE;
+        node.a = arms.empty() ? AST_NONE : arms[0];
+        node.b = arms.size();
+        return !arms.empty();
+    }
+
+    void forwardStatement(uint32_t n) {
+        AstNode &node = ast.nodes[n];
+        switch (node.kind) {
+            case AST_ASSIGN: {
+                node.b = propagate(node.b);
+                uint32_t target = ast[node.a].a;
+                if (ast[node.b].kind == AST_NAME) {
+                    uint32_t source = state[ast[node.b].a];
+                    mayFail[n] = source == UNDEFINED || source == MAYBE_UNDEFINED;
+                    set(target, UNKNOWN);
+                } else {
+                    set(target, node.b);
+                }
+                break;
+            }
+            case AST_PRINT: case AST_INPUT:
+                node.a = propagate(node.a);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // forward passes over a block's statements, ifs without arms are unlinked
+    // and ifs left with only an else are replaced by its statements
+    void forwardBlock(uint32_t block) {
+        uint32_t prev = AST_NONE, count = 0;
+        for (uint32_t s = ast[block].a; s != AST_NONE;) {
+            uint32_t next = ast[s].next;
+            uint32_t first = s, last = s;
+            size_t length = 1;
+            if (ast[s].kind == AST_IF) {
+                if (!forwardIf(s)) {
+                    first = AST_NONE;
+                } else if (ast[s].b == 1 && ast[ast[s].a].a == AST_NONE) {
+                    stats.ifsFlattened++;
+                    uint32_t body = ast[ast[s].a].b;
+                    first = ast[body].a;
+                    length = ast[body].b;
+                    for (last = first; last != AST_NONE && ast[last].next != AST_NONE;) last = ast[last].next;
+                    if (first == AST_NONE) length = 0;
+                }
+            } else {
+                forwardStatement(s);
+            }
+            if (first != AST_NONE) {
+                if (prev == AST_NONE) ast.nodes[block].a = first;
+                else ast.nodes[prev].next = first;
+                ast.nodes[last].next = next;
+                prev = last;
+                count += length;
+            }
+            s = next;
+        }
+        if (prev == AST_NONE) ast.nodes[block].a = AST_NONE;
+        else ast.nodes[prev].next = AST_NONE;
+        ast.nodes[block].b = count;
+    }
+
+    void use(uint32_t n, LiveSet &live) const {
+        if (ast[n].kind == AST_NAME) live.set(ast[n].a, true);
+    }
+
+    // removes the dead assignments of a block given what is live after it,
+    // live becomes what is live before it
+    void backwardBlock(uint32_t block, LiveSet &live) {
+        vector<uint32_t> statements;
+        for (uint32_t s = ast[block].a; s != AST_NONE; s = ast[s].next) statements.push_back(s);
+        vector<uint32_t> kept;
+        for (size_t i = statements.size(); i-- > 0;) {
+            uint32_t s = statements[i];
+            const AstNode &node = ast[s];
+            switch (node.kind) {
+                case AST_ASSIGN: {
+                    uint32_t target = ast[node.a].a;
+                    if (!live.test(target) && !mayFail[s]) {
+                        stats.deadStores++;
+                        continue;
+                    }
+                    live.set(target, false);
+                    use(node.b, live);
+                    break;
+                }
+                case AST_PRINT: case AST_INPUT:
+                    use(node.a, live);
+                    break;
+                case AST_IF: {
+                    // from the last arm back: an arm's test, then its body or the arms after it
+                    vector<uint32_t> arms;
+                    for (uint32_t br = node.a; br != AST_NONE; br = ast[br].next) arms.push_back(br);
+                    LiveSet rest = live;
+                    for (size_t k = arms.size(); k-- > 0;) {
+                        const AstNode &branch = ast[arms[k]];
+                        LiveSet body = live;
+                        backwardBlock(branch.b, body);
+                        if (branch.a == AST_NONE) {
+                            rest = body;
+                            continue;
+                        }
+                        rest.unite(body);
+                        use(ast[branch.a].a, rest);
+                        use(ast[branch.a].b, rest);
+                    }
+                    live = rest;
+                    break;
+                }
+                default:
+                    break;
+            }
+            kept.push_back(s);
+        }
+        reverse(kept.begin(), kept.end());
+        for (size_t i = 0; i < kept.size(); ++i) ast.nodes[kept[i]].next = i + 1 < kept.size() ? kept[i + 1] : AST_NONE;
+        ast.nodes[block].a = kept.empty() ? AST_NONE : kept[0];
+        ast.nodes[block].b = kept.size();
+    }
+
+    size_t countStatements(uint32_t block) const {
+        size_t n = 0;
+        for (uint32_t s = ast[block].a; s != AST_NONE; s = ast[s].next) {
+            n++;
+            if (ast[s].kind != AST_IF) continue;
+            for (uint32_t br = ast[s].a; br != AST_NONE; br = ast[br].next) n += countStatements(ast[br].b);
+        }
+        return n;
+    }
+
+public:
+    Optimizer(Ast &ast, OptimizerStats &stats) : ast(ast), stats(stats) {}
+
+    void run() {
+        PhaseScope phase("optimize");
+        if (ast.root == AST_NONE) return;
+        stats.statementsBefore = countStatements(ast.root);
+        state.assign(ast.names.size(), UNDEFINED);
+        undo.clear();
+        mayFail.assign(ast.nodes.size(), 0);
+
+        auto start = chrono::steady_clock::now();
+        {
+            PhaseScope forward("optimize forward");
+            forwardBlock(ast.root);
+        }
+        auto middle = chrono::steady_clock::now();
+        {
+            PhaseScope backward("optimize backward");
+            LiveSet live(ast.names.size());
+            backwardBlock(ast.root, live);
+        }
+        auto end = chrono::steady_clock::now();
+        stats.forwardSeconds = chrono::duration<double>(middle - start).count();
+        stats.backwardSeconds = chrono::duration<double>(end - middle).count();
+        stats.statementsAfter = countStatements(ast.root);
+    }
+};
+
+// runs every pass over ast, stats gets what each did
+void optimizeAst(Ast &ast, OptimizerStats &stats) {
+    Optimizer(ast, stats).run();
+}
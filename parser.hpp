@@ -3,114 +3,166 @@
 #include <unordered_map>
 #include <set>
 #include <iostream>
+#include <mutex>
+#include <atomic>
 
 using namespace std;
 
-struct Item {
-    string lhs;
-    vector<string> rhs;
-    int dotPos;
-    string lookahead;
+// An LR(1) item packed into 64 bits so item sets are flat sorted arrays:
+// production index (24 bits) | dot position (16 bits) | lookahead terminal id (24 bits)
+// Sorting the keys orders items by production, then dot, then lookahead.
+typedef uint64_t Item;
 
-    bool operator==(const Item &other) const {
-        if (lhs != other.lhs) return false;
-        if (rhs != other.rhs) return false;
-        if (dotPos != other.dotPos) return false;
-        return lookahead == other.lookahead;
-    }
+inline Item makeItem(uint32_t prod, uint32_t dot, uint32_t lookahead) {
+    return (uint64_t(prod) << 40) | (uint64_t(dot) << 24) | lookahead;
+}
+
+inline int itemProd(Item it) {
+    return int(it >> 40);
+}
+
+inline int itemDot(Item it) {
+    return int((it >> 24) & 0xFFFF);
+}
+
+inline int itemLookahead(Item it) {
+    return int(it & 0xFFFFFF);
+}
 
-    bool operator<(const Item &other) const {
-        if (lhs != other.lhs) return lhs < other.lhs;
-        if (rhs != other.rhs) return rhs < other.rhs;
-        if (dotPos != other.dotPos) return dotPos < other.dotPos;
-        return lookahead < other.lookahead;
+// symbol after the dot, -1 if the item is complete
+inline int itemNextSymbol(Item it, const CFG &grammar) {
+    int p = itemProd(it);
+    int dot = itemDot(it);
+    return dot < grammar.rhsLength(p) ? grammar.rhsBegin(p)[dot] : -1;
+}
+
+string itemToString(Item it, const CFG &grammar) {
+    int p = itemProd(it);
+    const int *rhs = grammar.rhsBegin(p);
+    int len = grammar.rhsLength(p);
+    string result = grammar.symbolNames[grammar.prodLhs[p]] + " → ";
+    for (int i = 0; i <= len; ++i) {
+        if (i == itemDot(it)) result += "•";
+        if (i < len) result += grammar.symbolNames[rhs[i]] + " ";
     }
+    result += ", " + grammar.symbolNames[itemLookahead(it)];
+    return result;
+}
 
-    string toString() const {
-        string result = lhs + " → ";
-        for (int i = 0; i <= rhs.size(); ++i) {
-            if (i == dotPos) result += "•";
-            if (i < rhs.size()) result += rhs[i] + " ";
-        }
-        result += ", " + lookahead;
-        return result;
+// the packed layout caps the grammar size
+void checkItemLimits(const CFG &grammar) {
+    int longest = 0;
+    for (int p = 0; p < grammar.numProductions(); ++p) longest = max(longest, grammar.rhsLength(p));
+    if (grammar.numProductions() >= (1 << 24) || grammar.numTerminals >= (1 << 24) || longest >= 0xFFFF) {
+        throw runtime_error("grammar too large for packed LR(1) items");
     }
-    void initItem(const string LHS,
-                   const vector<string> RHS,
-                   int dot,
-                   const string LA) {
-         lhs       = LHS;
-         rhs       = RHS;
-         dotPos    = dot;
-         lookahead = LA;
-     }
-};
+}
 
 struct ItemSet {
-    set<Item> items;
+    vector<Item> items;     // sorted and unique once finalize() ran
+    size_t hash = 0;
+
+    // sort, drop duplicates and compute the hash
+    void finalize() {
+        sort(items.begin(), items.end());
+        items.erase(unique(items.begin(), items.end()), items.end());
+        uint64_t h = 0xcbf29ce484222325ULL ^ items.size();
+        for (Item it : items) {
+            h ^= it + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+        }
+        hash = h;
+    }
 
     bool operator==(const ItemSet &other) const {
-        return items == other.items;
+        return hash == other.hash && items == other.items;
     }
 
-    string toString() const {
+    string toString(const CFG &grammar) const {
         string res = "{\n";
-        for (const auto &item : items) {
-            res += "  " + item.toString() + "\n";
+        for (Item item : items) {
+            res += "  " + itemToString(item, grammar) + "\n";
         }
         res += "}";
         return res;
     }
 
-    void addItem(const Item &item) {
-        items.insert(item);
+    bool contains(Item item) const {
+        return binary_search(items.begin(), items.end(), item);
     }
+};
 
-    bool contains(const Item &item) const {
-        return items.find(item) != items.end();
-    }
-     bool operator<(const ItemSet &other) const {
-        return items < other.items;
+struct ItemSetHash {
+    size_t operator()(const ItemSet &s) const {
+        return s.hash;
     }
 };
 
+ItemSet computeClosure(const ItemSet &inputSet, const CFG &grammar);
+struct ClosureEngine;
+
+// Which automaton buildLRCollection builds
+enum LRMode {
+    LR_CANONICAL,   // canonical LR(1), one state per distinct LR(1) kernel
+    LR_LALR         // LALR(1), LR(0) states with propagated lookaheads
+};
+
+// How the LR builders lay out their states
+struct LRBuildOptions {
+    LRMode mode = LR_CANONICAL;
+    // memoizing closure engine to use, one is created for the build if null.
+    // Parallel builds give every worker its own and add their counters to this one.
+    ClosureEngine *engine = nullptr;
+    // build the canonical collection on this pool, level by level
+    ThreadPool *pool = nullptr;
+    // keep only kernels in the states, closures are recomputed on demand
+    bool kernelOnly = false;
+    // upper bound on the items held by a ClosureCache built for these states
+    size_t closureCacheItems = 1 << 20;
+};
+
 struct DFA_State {
     int id;
-    ItemSet items;
+    ItemSet kernel;     // items the state was reached with, its identity
+    ItemSet items;      // closure of the kernel, left empty for kernel-only states
+    bool hasClosure;
     unordered_map<string, int> transitions;  // Symbol -> next state ID
+    vector<pair<int, int> > edges;           // (symbol id, next state ID) in symbol id order
     bool isAccepting;  // True if this state contains S' → program•
 
-    // Constructor
-    DFA_State(int id, const ItemSet& items) : id(id), items(items) {
-        // Check if this is an accepting state (contains S' → program•, $)
-        isAccepting = false;
-        for (const Item& item : items.items) {
-            if (item.lhs == "S'" && 
-                item.rhs.size() == 1 && 
-                item.rhs[0] == "program" && 
-                item.dotPos == 1 && 
-                item.lookahead == "$") {
-                isAccepting = true;
-                break;
-            }
-        }
+    // Constructor, a kernel-only state when items is null
+    DFA_State(int id, const ItemSet &kernel, const ItemSet *items, const CFG &grammar)
+        : id(id), kernel(kernel), hasClosure(items != nullptr) {
+        if (items) this->items = *items;
+        // accepting if it contains S' → program•, $ which is always a kernel item
+        isAccepting = kernel.contains(makeItem(0, 1, grammar.endMarker));
+    }
+
+    // the closure, computed from the kernel if the state does not keep it
+    ItemSet closure(const CFG &grammar) const {
+        return hasClosure ? items : computeClosure(kernel, grammar);
+    }
+
+    void addTransition(int symbol, int target, const CFG &grammar) {
+        edges.push_back({symbol, target});
+        transitions[grammar.symbolNames[symbol]] = target;
     }
 
     // For printing the state
-    string toString() const {
+    string toString(const CFG &grammar) const {
         string result = "State " + to_string(id) + ":\n";
         result += (isAccepting ? "[ACCEPTING]\n" : "");
-        
+
         // Print all items
-        for (const Item& item : items.items) {
-            result += "  " + item.toString() + "\n";
+        ItemSet all = closure(grammar);
+        for (Item item : all.items) {
+            result += "  " + itemToString(item, grammar) + "\n";
         }
 
         // Print transitions
-        if (!transitions.empty()) {
+        if (!edges.empty()) {
             result += "  Transitions:\n";
-            for (const auto& trans : transitions) {
-                result += "    " + trans.first + " → State " + to_string(trans.second) + "\n";
+            for (const auto &trans : edges) {
+                result += "    " + grammar.symbolNames[trans.first] + " → State " + to_string(trans.second) + "\n";
             }
         }
 
@@ -118,187 +170,638 @@ struct DFA_State {
     }
 
     // For comparing states (used in stateMap)
-    bool operator==(const DFA_State& other) const {
-        return items == other.items;
+    bool operator==(const DFA_State &other) const {
+        return kernel == other.kernel;
     }
 };
 
-set<string> computeFirstFromSeq(vector<string> sequence, CFG &grammar) {
-    set<string> ans;
-    bool allEpsilon = true;
+// FIRST(sequence lookahead) as a bitset over terminal ids
+SymbolSet computeFirstFromSeq(const int *sequence, int len, int lookahead, const CFG &grammar) {
+    const GrammarAnalysis &an = grammar.analysis;
+    SymbolSet ans(grammar.numTerminals);
 
-    for (const auto& symbol : sequence) {
-        if (grammar.isTerminal(symbol)) {
-            if (symbol != "EPSILON") {
-                ans.insert(symbol);
+    for (int i = 0; i < len; ++i) {
+        ans.unionWith(an.first[sequence[i]]);
+        if (!an.nullable[sequence[i]]) return ans;
+    }
+    ans.set(lookahead);
+    return ans;
+}
+
+ItemSet computeClosure(const ItemSet &inputSet, const CFG &grammar) {
+    ItemSet closureSet = inputSet;
+    unordered_set<Item> seen(inputSet.items.begin(), inputSet.items.end());
+    vector<Item> workQ(inputSet.items.begin(), inputSet.items.end());
+
+    while (!workQ.empty()) {
+        Item curr = workQ.back();
+        workQ.pop_back();
+
+        int B = itemNextSymbol(curr, grammar);
+        if (B < 0 || grammar.isTerminalId(B))
+            continue;
+
+        // lookaheads of the new items are FIRST(beta a)
+        int p = itemProd(curr);
+        int dot = itemDot(curr);
+        SymbolSet lookaheads = computeFirstFromSeq(grammar.rhsBegin(p) + dot + 1, grammar.rhsLength(p) - dot - 1,
+                                                   itemLookahead(curr), grammar);
+
+        for (int prod : grammar.prodsByLhs[B - grammar.numTerminals]) {
+            lookaheads.forEach([&](int la) {
+                Item newItem = makeItem(prod, 0, la);
+                if (seen.insert(newItem).second) {
+                    closureSet.items.push_back(newItem);
+                    workQ.push_back(newItem);
+                }
+            });
+        }
+    }
+
+    closureSet.finalize();
+    stats.add(STAT_CLOSURE_CALLS, 1);
+    stats.add(STAT_ITEMS_CREATED, closureSet.items.size() - inputSet.items.size());
+    return closureSet;
+}
+
+
+// Closure with memoization, for building many states over one grammar.
+// In a closure all items [C → •γ, b] of one nonterminal C share their
+// lookaheads, so a closure is a lookahead set per reached nonterminal:
+//  - FIRST(beta) is cached per rhs position, FIRST(beta a) is then a bitset
+//    union plus a when beta is nullable
+//  - expanding a nonterminal B is memoized: which nonterminals it reaches,
+//    the lookaheads they get regardless of B's own lookahead set, and which
+//    of them also inherit that set (through nullable suffixes)
+// A kernel item with B after the dot then costs a few bitset unions over
+// B's memoized expansion instead of a worklist run over the productions.
+struct ClosureEngine {
+    const CFG &grammar;
+
+    // FIRST of the rhs suffix after position k of rhsSymbols, by k
+    vector<int> suffixSlot;            // -1 until computed, else index into suffixFirst
+    vector<SymbolSet> suffixFirst;
+    vector<char> suffixNullable;
+
+    struct Reach {
+        int nonTerminal;
+        SymbolSet lookaheads;   // generated inside the expansion
+        bool inherits;          // also gets the lookaheads B was expanded with
+    };
+    vector<int> expansionSlot;         // by nonterminal index, -1 until computed
+    vector<vector<Reach> > expansions;
+
+    // scratch for closure(): lookaheads per nonterminal index, and which are set
+    vector<SymbolSet> scratchLA;
+    vector<int> touched;
+
+    size_t closureCalls = 0;
+    size_t expandHits = 0, expandMisses = 0;
+    size_t firstHits = 0, firstMisses = 0;
+    size_t itemsCreated = 0;
+
+    // counters of another engine over the same grammar, for per-thread engines
+    void addCounters(const ClosureEngine &other) {
+        closureCalls += other.closureCalls;
+        expandHits += other.expandHits;
+        expandMisses += other.expandMisses;
+        firstHits += other.firstHits;
+        firstMisses += other.firstMisses;
+        itemsCreated += other.itemsCreated;
+    }
+
+    ClosureEngine(const CFG &grammar)
+        : grammar(grammar), suffixSlot(grammar.rhsSymbols.size(), -1),
+          expansionSlot(grammar.numSymbols - grammar.numTerminals, -1),
+          scratchLA(grammar.numSymbols - grammar.numTerminals, SymbolSet(grammar.numTerminals)) {}
+
+    // FIRST of what follows the symbol at rhs position k, and whether it can vanish
+    int suffix(int k) {
+        if (suffixSlot[k] >= 0) {
+            firstHits++;
+            return suffixSlot[k];
+        }
+        firstMisses++;
+        const GrammarAnalysis &an = grammar.analysis;
+        int p = upper_bound(grammar.prodStart.begin(), grammar.prodStart.end(), k) - grammar.prodStart.begin() - 1;
+        int end = grammar.prodStart[p + 1];
+        SymbolSet first(grammar.numTerminals);
+        bool nullable = true;
+        for (int i = k + 1; i < end && nullable; ++i) {
+            int sym = grammar.rhsSymbols[i];
+            first.unionWith(an.first[sym]);
+            nullable = an.nullable[sym];
+        }
+        suffixSlot[k] = suffixFirst.size();
+        suffixFirst.push_back(first);
+        suffixNullable.push_back(nullable);
+        return suffixSlot[k];
+    }
+
+    // expansion of nonterminal index b, computed once by a worklist over the nonterminals it reaches
+    const vector<Reach> &expand(int b) {
+        if (expansionSlot[b] >= 0) {
+            expandHits++;
+            return expansions[expansionSlot[b]];
+        }
+        expandMisses++;
+
+        int numT = grammar.numTerminals;
+        vector<Reach> reach;
+        unordered_map<int, int> where;    // nonterminal index -> position in reach
+        reach.push_back({b, SymbolSet(numT), true});
+        where[b] = 0;
+        vector<int> work = {0};
+        vector<char> queued(1, 1);
+        while (!work.empty()) {
+            int r = work.back();
+            work.pop_back();
+            queued[r] = 0;
+            int C = reach[r].nonTerminal;
+            for (int prod : grammar.prodsByLhs[C]) {
+                if (grammar.rhsLength(prod) == 0) continue;
+                int D = grammar.rhsBegin(prod)[0];
+                if (grammar.isTerminalId(D)) continue;
+                int slot = suffix(grammar.prodStart[prod]);
+                bool fromC = suffixNullable[slot] && (reach[r].inherits || !reach[r].lookaheads.empty());
+                if (suffixFirst[slot].empty() && !fromC) continue;   // no lookahead ever reaches D this way
+
+                auto it = where.find(D - numT);
+                int d;
+                if (it == where.end()) {
+                    d = reach.size();
+                    where[D - numT] = d;
+                    reach.push_back({D - numT, SymbolSet(numT), false});
+                    queued.push_back(0);
+                } else {
+                    d = it->second;
+                }
+
+                // D gets FIRST(delta), plus whatever C has when delta can vanish
+                bool changed = reach[d].lookaheads.unionWith(suffixFirst[slot]);
+                if (fromC) {
+                    SymbolSet la = reach[r].lookaheads;
+                    changed |= reach[d].lookaheads.unionWith(la);
+                    if (reach[r].inherits && !reach[d].inherits) {
+                        reach[d].inherits = true;
+                        changed = true;
+                    }
+                }
+                if ((changed || it == where.end()) && !queued[d]) {
+                    queued[d] = 1;
+                    work.push_back(d);
+                }
             }
-            allEpsilon = false;
-            break; // Stop at first terminal (unless EPSILON)
         }
 
-        const set<string>& firstSet = grammar.first[symbol];
-        for (const string& tok : firstSet) {
-            if (tok != "EPSILON") ans.insert(tok);
+        expansionSlot[b] = expansions.size();
+        expansions.push_back(move(reach));
+        return expansions.back();
+    }
+
+    ItemSet closure(const ItemSet &kernel) {
+        closureCalls++;
+        int numT = grammar.numTerminals;
+        SymbolSet incoming(numT);
+
+        for (Item item : kernel.items) {
+            int B = itemNextSymbol(item, grammar);
+            if (B < 0 || grammar.isTerminalId(B)) continue;
+
+            // FIRST(beta a) for the item
+            int slot = suffix(grammar.prodStart[itemProd(item)] + itemDot(item));
+            incoming = suffixFirst[slot];
+            if (suffixNullable[slot]) incoming.set(itemLookahead(item));
+            if (incoming.empty()) continue;
+
+            for (const Reach &r : expand(B - numT)) {
+                SymbolSet &la = scratchLA[r.nonTerminal];
+                if (la.empty()) touched.push_back(r.nonTerminal);
+                la.unionWith(r.lookaheads);
+                if (r.inherits) la.unionWith(incoming);
+            }
         }
 
-        if (firstSet.find("EPSILON") == firstSet.end()) {
-            allEpsilon = false;
-            break;
+        // productions in id order and lookaheads ascending give sorted items
+        vector<int> prods;
+        for (int c : touched) {
+            for (int prod : grammar.prodsByLhs[c]) prods.push_back(prod);
         }
+        sort(prods.begin(), prods.end());
+
+        ItemSet result;
+        result.items = kernel.items;
+        size_t kernelCount = result.items.size();
+        for (int prod : prods) {
+            scratchLA[grammar.prodLhs[prod] - numT].forEach([&](int b) {
+                result.items.push_back(makeItem(prod, 0, b));
+            });
+        }
+        itemsCreated += result.items.size() - kernelCount;
+        stats.add(STAT_CLOSURE_CALLS, 1);
+        stats.add(STAT_ITEMS_CREATED, result.items.size() - kernelCount);
+        for (int c : touched) scratchLA[c] = SymbolSet(numT);
+        touched.clear();
+
+        inplace_merge(result.items.begin(), result.items.begin() + kernelCount, result.items.end());
+        result.finalize();
+        return result;
     }
 
-    if (allEpsilon) ans.insert("EPSILON");
-    
-    return ans;
-}
+    static double rate(size_t hits, size_t misses) {
+        return hits + misses ? 100.0 * hits / (hits + misses) : 0.0;
+    }
+
+    void report(ostream &out) const {
+        streamsize precision = out.precision();
+        out << "closure calls: " << closureCalls << ", items created: " << itemsCreated
+            << ", nonterminal expansion memo: " << expandHits << " hits / " << expandMisses << " misses ("
+            << fixed << setprecision(1) << rate(expandHits, expandMisses) << "%)"
+            << ", FIRST(beta) cache: " << firstHits << " hits / " << firstMisses << " misses ("
+            << rate(firstHits, firstMisses) << "%)" << defaultfloat << setprecision(precision) << "\n";
+    }
+};
 
-ItemSet computeClosure(const ItemSet &inputSet, CFG &grammar) {
 
-    ItemSet closureSet = inputSet;
-    queue<Item> workQ;
+// LRU cache of closures for kernel-only states, bounded by the number of items it holds
+struct ClosureCache {
+    const CFG &grammar;
+    ClosureEngine *engine;   // optional, memoized closures
+    size_t itemLimit;
+    size_t itemCount = 0;
+    list<int> recent;   // most recently used state first
+    unordered_map<int, pair<ItemSet, list<int>::iterator> > entries;
+    size_t hits = 0, misses = 0;
+
+    ClosureCache(const CFG &grammar, size_t itemLimit = 1 << 20, ClosureEngine *engine = nullptr)
+        : grammar(grammar), engine(engine), itemLimit(itemLimit) {}
+
+    // closure of state, the reference stays valid until the next call
+    const ItemSet &get(const DFA_State &state) {
+        if (state.hasClosure) return state.items;
+
+        auto found = entries.find(state.id);
+        if (found != entries.end()) {
+            hits++;
+            recent.splice(recent.begin(), recent, found->second.second);
+            return found->second.first;
+        }
 
-    for (const Item &it : inputSet.items) {
-        workQ.push(it);
+        misses++;
+        ItemSet closure = engine ? engine->closure(state.kernel) : computeClosure(state.kernel, grammar);
+        // evict least recently used entries, the new one is always kept
+        while (!recent.empty() && itemCount + closure.items.size() > itemLimit) {
+            auto victim = entries.find(recent.back());
+            itemCount -= victim->second.first.items.size();
+            entries.erase(victim);
+            recent.pop_back();
+        }
+        itemCount += closure.items.size();
+        recent.push_front(state.id);
+        auto inserted = entries.emplace(state.id, make_pair(move(closure), recent.begin()));
+        return inserted.first->second.first;
     }
-	
-    while (!workQ.empty()) {
-        Item curr = workQ.front();
-        workQ.pop();
+};
 
-        if (curr.dotPos >= curr.rhs.size()) 
-            continue;
 
-        string B = curr.rhs[curr.dotPos];
-        if (!grammar.isNonTerminal(B)) 
-            continue;
+// Open addressing table from kernels to state ids. The kernels are not
+// copied, slots hold state ids and compare against the states' own kernels.
+struct StateTable {
+    vector<int> slots;
+    size_t count = 0;
+
+    StateTable() : slots(64, -1) {}
 
-        vector<string> beta;
-        for (int i = curr.dotPos + 1; i < curr.rhs.size(); ++i) {
-            beta.push_back(curr.rhs[i]);
+    // id of the state with this kernel, -1 if there is none
+    int find(const ItemSet &kernel, const vector<DFA_State> &states) const {
+        size_t mask = slots.size() - 1;
+        for (size_t i = kernel.hash & mask; ; i = (i + 1) & mask) {
+            int id = slots[i];
+            if (id < 0) return -1;
+            if (states[id].kernel == kernel) return id;
         }
-        beta.push_back(curr.lookahead);
-
-        // Computing first
-        set<string> lookaheads = computeFirstFromSeq(beta, grammar);
-		if(lookaheads.empty()) lookaheads.insert("$");
-
-        for (const auto &prod : grammar.production) {
-            if (prod.first != B) 
-                continue;
-
-            for (const string &la : lookaheads) {
-                Item newItem;
-                newItem.lhs       = B;
-                newItem.rhs       = prod.second;
-                newItem.dotPos    = 0;
-                newItem.lookahead = la;
-
-                if (!closureSet.contains(newItem)) {
-                    closureSet.addItem(newItem);
-                    workQ.push(newItem);
-                }
-            }
+    }
+
+    void insert(int id, const vector<DFA_State> &states) {
+        if (2 * (count + 1) > slots.size()) {
+            vector<int> old;
+            old.swap(slots);
+            slots.assign(old.size() * 2, -1);
+            for (int other : old) if (other >= 0) place(other, states);
         }
+        place(id, states);
+        count++;
     }
 
-    return closureSet;
-}
+    void place(int id, const vector<DFA_State> &states) {
+        size_t mask = slots.size() - 1;
+        size_t i = states[id].kernel.hash & mask;
+        while (slots[i] >= 0) i = (i + 1) & mask;
+        slots[i] = id;
+    }
+};
 
 
-ItemSet GOTO(ItemSet I, const string &X, CFG &grammar) {
+// kernel of GOTO(I, X): every item of I with X after the dot, dot advanced
+ItemSet gotoKernel(const ItemSet &I, int X, const CFG &grammar) {
     ItemSet J;
-    for (const Item &item : I.items) {
-        if (item.dotPos < item.rhs.size() && item.rhs[item.dotPos] == X) {
-            Item newItem = item;
-            newItem.dotPos++;
-            J.addItem(newItem);
+    for (Item item : I.items) {
+        if (itemNextSymbol(item, grammar) == X) {
+            J.items.push_back(item + (uint64_t(1) << 24));
         }
     }
-    return computeClosure(J, grammar);
+    J.finalize();
+    return J;
+}
+
+ItemSet GOTO(const ItemSet &I, int X, const CFG &grammar) {
+    return computeClosure(gotoKernel(I, X, grammar), grammar);
 }
 
-vector<DFA_State> buildCanonicalCollection(CFG &grammar) {
+// BFS over the states reachable from startKernel, in state id order; closure
+// gives the full item set of a kernel. States keep their closures unless
+// kernelOnly is set.
+vector<DFA_State> buildItemAutomaton(const ItemSet &startKernel, const function<ItemSet(const ItemSet &)> &untimedClosure,
+                                     bool kernelOnly, const CFG &grammar) {
+    PhaseScope phase("LR automaton");
+    auto closure = [&](const ItemSet &kernel) {
+        StatTimer timer(STAT_CLOSURE_NS);
+        return untimedClosure(kernel);
+    };
     vector<DFA_State> states;
-    map<ItemSet, int> stateMap;    // ItemSet → state ID
-    queue<ItemSet> workQueue;
-
-    // 1) Create the initial item S' → • program, $
-    Item startItem;
-    startItem.lhs       = "S'";
-    startItem.rhs       = {"program"};
-    startItem.dotPos    = 0;
-    startItem.lookahead = "$";
-
-    ItemSet startSet;
-    startSet.addItem(startItem);
-    startSet = computeClosure(startSet, grammar);
-
-    // 2) Create initial DFA_State
-    states.emplace_back(0, startSet);
-    stateMap[startSet] = 0;
-    workQueue.push(startSet);
-
-    // 3) Process queue
+    StateTable stateMap;    // kernel → state ID
+    queue<int> workQueue;
+
+    // 1) Create initial DFA_State
+    ItemSet startClosure = closure(startKernel);
+    states.emplace_back(0, startKernel, kernelOnly ? nullptr : &startClosure, grammar);
+    stateMap.insert(0, states);
+    workQueue.push(0);
+    stats.add(STAT_STATES, 1);
+
+    // 2) Process queue
+    vector<vector<Item> > buckets(grammar.numSymbols);
+    vector<int> symbols;
     while (!workQueue.empty()) {
-        ItemSet currentSet = workQueue.front(); 
+        int currID = workQueue.front();
         workQueue.pop();
 
-        int currID = stateMap[currentSet];
-        DFA_State &currState = states[currID];
+        // kernel-only states get their closure back just for this step
+        ItemSet scratch;
+        const ItemSet *items = &states[currID].items;
+        if (!states[currID].hasClosure) {
+            scratch = closure(states[currID].kernel);
+            items = &scratch;
+        }
 
-        // 4) Gather all symbols X that appear immediately after a dot
-        set<string> symbols;
-        for (const Item &it : currentSet.items) {
-            if (it.dotPos < it.rhs.size()) {
-                symbols.insert(it.rhs[it.dotPos]);
+        // 3) Split the items by the symbol after the dot, advancing the dot
+        symbols.clear();
+        for (Item it : items->items) {
+            int X = itemNextSymbol(it, grammar);
+            if (X < 0) continue;
+            if (buckets[X].empty()) symbols.push_back(X);
+            buckets[X].push_back(it + (uint64_t(1) << 24));
+        }
+        sort(symbols.begin(), symbols.end());
+
+        // 4) Each bucket is the kernel of GOTO(state, X)
+        for (int X : symbols) {
+            ItemSet kernel;
+            kernel.items.swap(buckets[X]);
+            kernel.finalize();
+
+            // 5) If new, assign ID and enqueue
+            int targetID;
+            {
+                StatTimer timer(STAT_STATE_LOOKUP_NS);
+                targetID = stateMap.find(kernel, states);
+            }
+            stats.add(STAT_STATE_LOOKUPS, 1);
+            if (targetID < 0) {
+                stats.add(STAT_STATES, 1);
+                targetID = states.size();
+                if (kernelOnly) {
+                    states.emplace_back(targetID, kernel, nullptr, grammar);
+                } else {
+                    ItemSet full = closure(kernel);
+                    states.emplace_back(targetID, kernel, &full, grammar);
+                }
+                stateMap.insert(targetID, states);
+                workQueue.push(targetID);
             }
+
+            // 6) Record transition
+            states[currID].addTransition(X, targetID, grammar);
+        }
+    }
+
+    return states;
+}
+
+// Kernel → state id table shared by the workers of a parallel build, split
+// into shards with a lock each so inserts of different kernels rarely contend
+struct ShardedStateTable {
+    struct Shard {
+        mutex lock;
+        unordered_map<ItemSet, int, ItemSetHash> ids;
+    };
+    vector<Shard> shards;
+    atomic<int> nextId;
+
+    ShardedStateTable(size_t numShards, int firstId) : shards(numShards), nextId(firstId) {}
+
+    // id of kernel, a fresh one (and inserted = true) if it was not in the table
+    // kernelOut then points at the table's copy, which stays put
+    int findOrInsert(ItemSet &&kernel, bool &inserted, const ItemSet *&kernelOut) {
+        StatTimer timer(STAT_STATE_LOOKUP_NS);
+        stats.add(STAT_STATE_LOOKUPS, 1);
+        Shard &shard = shards[(kernel.hash >> 7) % shards.size()];
+        unique_lock<mutex> guard(shard.lock);
+        auto found = shard.ids.find(kernel);
+        inserted = found == shard.ids.end();
+        if (inserted) {
+            found = shard.ids.emplace(move(kernel), nextId++).first;
+            stats.add(STAT_STATES, 1);
         }
+        kernelOut = &found->first;
+        return found->second;
+    }
+};
+
+// Canonical collection built one BFS level at a time on a thread pool. Each
+// worker takes a slice of the frontier and computes the GOTO kernels of its
+// states, new kernels get ids from a sharded table. Ids handed out that way
+// depend on scheduling, so the states are renumbered at the end by a BFS over
+// edges in symbol order, which gives exactly buildCanonicalCollection's numbering.
+vector<DFA_State> buildCanonicalCollectionParallel(CFG &grammar, ThreadPool &pool, const LRBuildOptions &options) {
+    PhaseScope phase("LR automaton (parallel)");
+    grammar.analyze();
+    checkItemLimits(grammar);
+
+    // engines memoize into unshared state, one per slice
+    size_t numSlices = max<size_t>(1, pool.size());
+    vector<unique_ptr<ClosureEngine> > engines;
+    for (size_t i = 0; i < numSlices; ++i) engines.emplace_back(new ClosureEngine(grammar));
+
+    ItemSet startKernel;
+    startKernel.items.push_back(makeItem(0, 0, grammar.endMarker));
+    startKernel.finalize();
+
+    ShardedStateTable table(64 * numSlices, 0);
+    bool inserted;
+    const ItemSet *kernel0;
+    ItemSet startCopy = startKernel;
+    table.findOrInsert(move(startCopy), inserted, kernel0);
+
+    vector<DFA_State> states;
+    ItemSet startClosure = engines[0]->closure(startKernel);
+    states.emplace_back(0, startKernel, options.kernelOnly ? nullptr : &startClosure, grammar);
+
+    struct NewState {
+        int id;
+        const ItemSet *kernel;
+        ItemSet closure;
+    };
+    struct SliceOutput {
+        vector<pair<int, pair<int, int> > > edges;   // (source, (symbol, target)), sources in frontier order
+        vector<NewState> created;
+    };
+    vector<SliceOutput> outputs(numSlices);
+
+    vector<int> frontier = {0};
+    while (!frontier.empty()) {
+        pool.parallelFor(numSlices, [&](size_t slice) {
+            PhaseScope slicePhase("LR level slice");
+            ClosureEngine &engine = *engines[slice];
+            SliceOutput &out = outputs[slice];
+            out.edges.clear();
+            out.created.clear();
+            vector<vector<Item> > buckets(grammar.numSymbols);
+            vector<int> symbols;
+            size_t begin = frontier.size() * slice / numSlices, end = frontier.size() * (slice + 1) / numSlices;
+            for (size_t f = begin; f < end; ++f) {
+                int currID = frontier[f];
+                ItemSet scratch;
+                const ItemSet *items = &states[currID].items;
+                if (!states[currID].hasClosure) {
+                    StatTimer timer(STAT_CLOSURE_NS);
+                    scratch = engine.closure(states[currID].kernel);
+                    items = &scratch;
+                }
 
-        // 5) For each symbol, compute GOTO
-        for (const string &X : symbols) {
-            ItemSet gotoSet = GOTO(currentSet, X, grammar);
-            if (gotoSet.items.empty()) continue;
-
-            // 6) If new, assign ID and enqueue
-            if (!stateMap.count(gotoSet)) {
-                int newID = states.size();
-                states.emplace_back(newID, gotoSet);
-                stateMap[gotoSet] = newID;
-                workQueue.push(gotoSet);
+                symbols.clear();
+                for (Item it : items->items) {
+                    int X = itemNextSymbol(it, grammar);
+                    if (X < 0) continue;
+                    if (buckets[X].empty()) symbols.push_back(X);
+                    buckets[X].push_back(it + (uint64_t(1) << 24));
+                }
+                sort(symbols.begin(), symbols.end());
+
+                for (int X : symbols) {
+                    ItemSet kernel;
+                    kernel.items.swap(buckets[X]);
+                    kernel.finalize();
+                    bool isNew;
+                    const ItemSet *stored;
+                    int target = table.findOrInsert(move(kernel), isNew, stored);
+                    if (isNew) {
+                        StatTimer timer(STAT_CLOSURE_NS);
+                        out.created.push_back({target, stored, options.kernelOnly ? ItemSet() : engine.closure(*stored)});
+                    }
+                    out.edges.push_back({currID, {X, target}});
+                }
             }
+        });
 
-            // 7) Record transition
-            int targetID = stateMap[gotoSet];
-            currState.transitions[X] = targetID;
+        // the new ids of this level are exactly [states.size(), nextId)
+        int first = states.size();
+        vector<NewState *> created(table.nextId - first, nullptr);
+        for (SliceOutput &out : outputs) {
+            for (NewState &ns : out.created) created[ns.id - first] = &ns;
+        }
+        frontier.clear();
+        for (NewState *ns : created) {
+            states.emplace_back(ns->id, *ns->kernel, options.kernelOnly ? nullptr : &ns->closure, grammar);
+            frontier.push_back(ns->id);
+        }
+        for (SliceOutput &out : outputs) {
+            for (const auto &edge : out.edges) states[edge.first].edges.push_back(edge.second);
         }
     }
 
-    return states;
+    if (options.engine) {
+        for (auto &engine : engines) options.engine->addCounters(*engine);
+    }
+
+    // renumber by a BFS from state 0 taking edges in symbol order
+    vector<int> newId(states.size(), -1), order;
+    newId[0] = 0;
+    order.push_back(0);
+    for (size_t i = 0; i < order.size(); ++i) {
+        for (const auto &edge : states[order[i]].edges) {
+            if (newId[edge.second] < 0) {
+                newId[edge.second] = order.size();
+                order.push_back(edge.second);
+            }
+        }
+    }
+    vector<DFA_State> result;
+    result.reserve(order.size());
+    for (int old : order) {
+        DFA_State &state = states[old];
+        result.emplace_back(newId[old], state.kernel, nullptr, grammar);
+        DFA_State &renumbered = result.back();
+        renumbered.items = move(state.items);
+        renumbered.hasClosure = state.hasClosure;
+        for (const auto &edge : state.edges) renumbered.addTransition(edge.first, newId[edge.second], grammar);
+    }
+    return result;
 }
 
-void printDFAStates(const vector<DFA_State> states) {
+vector<DFA_State> buildCanonicalCollection(CFG &grammar, const LRBuildOptions &options = LRBuildOptions()) {
+    if (options.pool) return buildCanonicalCollectionParallel(grammar, *options.pool, options);
+    grammar.analyze();
+    checkItemLimits(grammar);
+
+    ClosureEngine localEngine(grammar);
+    ClosureEngine &engine = options.engine ? *options.engine : localEngine;
+
+    // start from the item S' → • program, $
+    ItemSet startKernel;
+    startKernel.items.push_back(makeItem(0, 0, grammar.endMarker));
+    startKernel.finalize();
+
+    return buildItemAutomaton(startKernel, [&](const ItemSet &kernel) { return engine.closure(kernel); },
+                              options.kernelOnly, grammar);
+}
+
+void printDFAStates(const vector<DFA_State> &states, const CFG &grammar) {
+    ClosureCache cache(grammar);
     for (const DFA_State &state : states) {
         cout << "State " << state.id << ":\n";
 
         // Print each item in this state
-        for (const Item &item : state.items.items) {
-            cout << "  " << item.lhs << " -> ";
-            for (int i = 0; i <= item.rhs.size(); ++i) {
-                if (i == item.dotPos) cout << "• ";
-                if (i < item.rhs.size()) cout << item.rhs[i] << " ";
+        for (Item item : cache.get(state).items) {
+            int p = itemProd(item);
+            const int *rhs = grammar.rhsBegin(p);
+            int len = grammar.rhsLength(p);
+            cout << "  " << grammar.symbolNames[grammar.prodLhs[p]] << " -> ";
+            for (int i = 0; i <= len; ++i) {
+                if (i == itemDot(item)) cout << "• ";
+                if (i < len) cout << grammar.symbolNames[rhs[i]] << " ";
             }
-            cout << ", " << item.lookahead << "\n";
+            cout << ", " << grammar.symbolNames[itemLookahead(item)] << "\n";
         }
 
         // Print transitions
-        if (!state.transitions.empty()) {
+        if (!state.edges.empty()) {
             cout << "  Transitions:\n";
-            for (const auto &trans : state.transitions) {
-                cout << "    " << trans.first << " -> State " << trans.second << "\n";
+            for (const auto &trans : state.edges) {
+                cout << "    " << grammar.symbolNames[trans.first] << " -> State " << trans.second << "\n";
             }
         }
 
         cout << "-----------------------------\n";
     }
 }
-
@@ -0,0 +1,159 @@
+
+using namespace std;
+
+// Ahead-of-time parser generation. emitParserHeader writes ParseTables out as
+// a header (generatedParser.hpp) holding one struct of constexpr arrays with
+// the same interface as ParseTables, plus enums naming the terminals,
+// nonterminals and productions. BasicLRParser<GeneratedParseTables> is then a
+// parse loop specialized on those arrays, with no table construction at startup.
+// sameParseTables checks that a generated parser and runtime built tables
+// agree on every ACTION and GOTO entry, i.e. accept exactly the same inputs.
+
+// a symbol name as a C++ identifier: $ → END, S' → S_PRIME, other characters → _
+string generatedName(const string &name) {
+    if (name == "$") return "END";
+    string res;
+    for (char c : name) {
+        if (isalnum((unsigned char)c) || c == '_') res += c;
+        else if (c == '\'') res += "_PRIME";
+        else res += '_';
+    }
+    return res;
+}
+
+void emitIntArray(ostream &out, const char *name, const int32_t *data, size_t n) {
+    out << "    static constexpr int32_t " << name << "[" << max<size_t>(n, 1) << "] = {";
+    for (size_t i = 0; i < n; ++i) {
+        if (i % 16 == 0) out << "\n        ";
+        out << data[i] << (i + 1 < n ? ", " : "");
+    }
+    if (n == 0) out << "0";
+    out << "\n    };\n";
+}
+
+void emitParserHeader(const ParseTables &tables, uint64_t grammarHash, LRMode mode, const string &grammarFile,
+                      ostream &out) {
+    int numSymbols = tables.numTerminals + tables.numNonTerminals;
+    out << "// Generated from " << grammarFile << " by `compiler --emit-parser" << (mode == LR_LALR ? " --lalr" : "")
+        << "`, do not edit.\n"
+        << "// Included after lrParser.hpp, BasicLRParser<GeneratedParseTables> parses with these tables.\n\n"
+        << "using namespace std;\n\n";
+
+    out << "enum GeneratedTerminal {\n";
+    for (int t = 0; t < tables.numTerminals; ++t) {
+        out << "    T_" << generatedName(tables.symbolNames[t]) << " = " << t << ",\n";
+    }
+    out << "};\n\n";
+
+    out << "enum GeneratedNonTerminal {\n";
+    for (int nt = tables.numTerminals; nt < numSymbols; ++nt) {
+        out << "    NT_" << generatedName(tables.symbolNames[nt]) << " = " << nt << ",\n";
+    }
+    out << "};\n\n";
+
+    // productions are numbered per lhs: P_stmt_list_0, P_stmt_list_1, ...
+    out << "enum GeneratedProduction {\n";
+    vector<int> seen(numSymbols, 0);
+    for (size_t p = 0; p < tables.prodLhs.size(); ++p) {
+        int lhs = tables.prodLhs[p];
+        out << "    P_" << generatedName(tables.symbolNames[lhs]) << "_" << seen[lhs]++ << " = " << p << ",\n";
+    }
+    out << "};\n\n";
+
+    out << "struct GeneratedParseTables {\n"
+        << "    static constexpr uint64_t grammarHash = 0x" << hex << grammarHash << dec << "ULL;\n"
+        << "    static constexpr LRMode mode = " << (mode == LR_LALR ? "LR_LALR" : "LR_CANONICAL") << ";\n"
+        << "    static constexpr int numStates = " << tables.numStates << ";\n"
+        << "    static constexpr int numTerminals = " << tables.numTerminals << ";\n"
+        << "    static constexpr int numNonTerminals = " << tables.numNonTerminals << ";\n"
+        << "    static constexpr int endMarker = " << tables.endMarker << ";\n"
+        << "    static constexpr size_t actionSlots = " << tables.actions.slots << ";\n"
+        << "    static constexpr size_t gotoSlots = " << tables.gotos.slots << ";\n\n";
+    emitIntArray(out, "actionBase", tables.actions.baseAt, tables.actions.rows);
+    emitIntArray(out, "actionDefault", tables.actions.fallbackAt, tables.actions.rows);
+    emitIntArray(out, "actionNext", tables.actions.nextAt, tables.actions.slots);
+    emitIntArray(out, "actionCheck", tables.actions.checkAt, tables.actions.slots);
+    emitIntArray(out, "gotoBase", tables.gotos.baseAt, tables.gotos.rows);
+    emitIntArray(out, "gotoDefault", tables.gotos.fallbackAt, tables.gotos.rows);
+    emitIntArray(out, "gotoNext", tables.gotos.nextAt, tables.gotos.slots);
+    emitIntArray(out, "gotoCheck", tables.gotos.checkAt, tables.gotos.slots);
+    vector<int32_t> lhs(tables.prodLhs.begin(), tables.prodLhs.end());
+    vector<int32_t> len(tables.prodLength.begin(), tables.prodLength.end());
+    emitIntArray(out, "prodLhs", lhs.data(), lhs.size());
+    emitIntArray(out, "prodLength", len.data(), len.size());
+
+    out << "    static constexpr const char *symbolNames[" << numSymbols << "] = {";
+    for (int s = 0; s < numSymbols; ++s) {
+        if (s % 8 == 0) out << "\n        ";
+        out << "\"";
+        for (char c : tables.symbolNames[s]) {
+            if (c == '"' || c == '\\') out << '\\';
+            out << c;
+        }
+        out << "\"" << (s + 1 < numSymbols ? ", " : "");
+    }
+    out << "\n    };\n\n";
+
+    out << "    static constexpr int32_t action(int state, int terminal) {\n"
+        << "        int i = actionBase[state] + terminal;\n"
+        << "        return actionCheck[i] == state ? actionNext[i] : actionDefault[state];\n"
+        << "    }\n\n"
+        << "    static constexpr int gotoState(int state, int A) {\n"
+        << "        int i = gotoBase[A - numTerminals] + state;\n"
+        << "        return gotoCheck[i] == A - numTerminals ? gotoNext[i] : gotoDefault[A - numTerminals];\n"
+        << "    }\n\n"
+        << "    static constexpr bool isTerminalId(int id) {\n"
+        << "        return id < numTerminals;\n"
+        << "    }\n"
+        << "};\n\n"
+        << "typedef BasicLRParser<GeneratedParseTables> GeneratedLRParser;\n"
+        << "typedef BasicParseTree<GeneratedParseTables> GeneratedParseTree;\n";
+}
+
+// true when a generated parser's tables give the same action for every
+// (state, terminal) and the same goto for every (state, nonterminal) as the
+// runtime built ones, mismatches go to err
+template <class Generated>
+bool sameParseTables(const ParseTables &a, const Generated &b, ostream &err) {
+    if (a.numStates != b.numStates || a.numTerminals != b.numTerminals || a.numNonTerminals != b.numNonTerminals ||
+        a.endMarker != b.endMarker) {
+        err << "parse tables differ in shape\n";
+        return false;
+    }
+    int numSymbols = a.numTerminals + a.numNonTerminals;
+    for (int s = 0; s < numSymbols; ++s) {
+        if (string(a.symbolNames[s]) != string(b.symbolNames[s])) {
+            err << "symbol " << s << " is " << a.symbolNames[s] << " in one table and " << b.symbolNames[s] << " in the other\n";
+            return false;
+        }
+    }
+    size_t numProductions = sizeof(Generated::prodLhs) / sizeof(Generated::prodLhs[0]);
+    if (a.prodLhs.size() != numProductions) {
+        err << "parse tables differ in production count\n";
+        return false;
+    }
+    for (size_t p = 0; p < numProductions; ++p) {
+        if (a.prodLhs[p] != b.prodLhs[p] || a.prodLength[p] != b.prodLength[p]) {
+            err << "production " << p << " differs\n";
+            return false;
+        }
+    }
+
+    size_t mismatches = 0;
+    for (int state = 0; state < a.numStates; ++state) {
+        for (int t = 0; t < a.numTerminals; ++t) {
+            if (a.action(state, t) != b.action(state, t) && mismatches++ < 10) {
+                err << "ACTION[" << state << ", " << a.symbolNames[t] << "] differs\n";
+            }
+        }
+    }
+    for (int A = a.numTerminals; A < numSymbols; ++A) {
+        for (int state = 0; state < a.numStates; ++state) {
+            int x = a.gotoState(state, A), y = b.gotoState(state, A);
+            if (x != y && mismatches++ < 10) {
+                err << "GOTO[" << state << ", " << a.symbolNames[A] << "] differs\n";
+            }
+        }
+    }
+    return mismatches == 0;
+}
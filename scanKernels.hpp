@@ -0,0 +1,140 @@
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SCAN_KERNELS_X86 1
+#endif
+
+using namespace std;
+
+// Byte scanning kernels used by the lexer before any tokenization happens:
+// finding the end of a line and measuring its leading spaces/tabs.
+// Each kernel has a scalar version, an SSE2 version and an AVX2 version;
+// the widest one the CPU supports is picked once at startup.
+
+// returns the first '\n' in [p, end), or end
+static const char* findNewlineScalar(const char* p, const char* end) {
+    const char* nl = (const char*)memchr(p, '\n', end - p);
+    return nl ? nl : end;
+}
+
+// skips the leading spaces and tabs of [p, end) and returns the first other byte
+// indent is the width of the skipped prefix, a tab counting as 4 spaces
+static const char* scanIndentScalar(const char* p, const char* end, int& indent) {
+    indent = 0;
+    for (; p < end; ++p) {
+        if (*p == ' ') indent++;
+        else if (*p == '\t') indent += 4;
+        else break;
+    }
+    return p;
+}
+
+#ifdef SCAN_KERNELS_X86
+
+static const char* findNewlineSSE2(const char* p, const char* end) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return findNewlineScalar(p, end);
+}
+
+static const char* scanIndentSSE2(const char* p, const char* end, int& indent) {
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    int width = 0;
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        unsigned spaces = _mm_movemask_epi8(_mm_cmpeq_epi8(v, sp));
+        unsigned tabs = _mm_movemask_epi8(_mm_cmpeq_epi8(v, tab));
+        unsigned blank = spaces | tabs;
+        if (blank != 0xFFFF) {
+            int n = __builtin_ctz(~blank);
+            unsigned prefix = (1u << n) - 1;
+            indent = width + __builtin_popcount(spaces & prefix) + 4 * __builtin_popcount(tabs & prefix);
+            return p + n;
+        }
+        width += 16 + 3 * __builtin_popcount(tabs);
+        p += 16;
+    }
+    const char* q = scanIndentScalar(p, end, indent);
+    indent += width;
+    return q;
+}
+
+__attribute__((target("avx2")))
+static const char* findNewlineAVX2(const char* p, const char* end) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    while (end - p >= 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)p);
+        __m256i b = _mm256_loadu_si256((const __m256i*)(p + 32));
+        unsigned ma = _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, nl));
+        unsigned mb = _mm256_movemask_epi8(_mm256_cmpeq_epi8(b, nl));
+        if (ma | mb) {
+            uint64_t mask = ((uint64_t)mb << 32) | ma;
+            return p + __builtin_ctzll(mask);
+        }
+        p += 64;
+    }
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return findNewlineSSE2(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* scanIndentAVX2(const char* p, const char* end, int& indent) {
+    const __m256i sp = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    int width = 0;
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        unsigned spaces = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, sp));
+        unsigned tabs = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, tab));
+        unsigned blank = spaces | tabs;
+        if (blank != 0xFFFFFFFFu) {
+            int n = __builtin_ctz(~blank);
+            unsigned prefix = (1u << n) - 1;
+            indent = width + __builtin_popcount(spaces & prefix) + 4 * __builtin_popcount(tabs & prefix);
+            return p + n;
+        }
+        width += 32 + 3 * __builtin_popcount(tabs);
+        p += 32;
+    }
+    const char* q = scanIndentSSE2(p, end, indent);
+    indent += width;
+    return q;
+}
+
+#endif
+
+struct ScanKernels {
+    const char* (*findNewline)(const char*, const char*);
+    const char* (*scanIndent)(const char*, const char*, int&);
+    const char* name;
+
+    ScanKernels() {
+        findNewline = findNewlineScalar;
+        scanIndent = scanIndentScalar;
+        name = "scalar";
+#ifdef SCAN_KERNELS_X86
+        findNewline = findNewlineSSE2;
+        scanIndent = scanIndentSSE2;
+        name = "sse2";
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            findNewline = findNewlineAVX2;
+            scanIndent = scanIndentAVX2;
+            name = "avx2";
+        }
+#endif
+    }
+};
+
+static const ScanKernels scanKernels;
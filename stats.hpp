@@ -0,0 +1,304 @@
+#include <sys/resource.h>
+#include <time.h>
+
+using namespace std;
+
+// Run statistics behind --stats and --trace. Nothing is recorded unless
+// stats.enabled is set and every hook tests it first, so a normal run pays
+// one predictable branch per hook and never reads a clock.
+//  - PhaseScope times a block: wall time, CPU time of its thread and, in a
+//    build with -DSTATS_ALLOCATIONS, the bytes that thread allocated
+//    meanwhile. Every phase is kept as a trace event, phases nest by scope.
+//  - counters are summed over all threads
+//  - StatTimer adds the time of operations too short and too many to trace
+//    one by one (a closure, a state lookup) to a counter
+// writeSummary gives the JSON summary, phases totalled by name, and
+// writeTrace the Chrome trace format timeline (chrome://tracing, Perfetto).
+
+enum StatCounter {
+    STAT_TOKENS,            // tokens the lexer emitted
+    STAT_DFA_MATCHES,       // token DFA runs, one per lexeme attempt
+    STAT_SYMBOL_LOOKUPS,    // identifier and keyword interning lookups
+    STAT_CLOSURE_CALLS,
+    STAT_ITEMS_CREATED,     // closure items added to kernels
+    STAT_STATES,            // LR states created
+    STAT_STATE_LOOKUPS,     // kernel → state table lookups
+    STAT_CLOSURE_NS,
+    STAT_STATE_LOOKUP_NS,
+    STAT_INSTRUCTIONS,      // bytecode instructions executed
+    STAT_COUNT
+};
+
+const char *statCounterNames[STAT_COUNT] = {
+    "tokens", "dfaMatches", "symbolLookups", "closureCalls", "itemsCreated",
+    "states", "stateLookups", "closureNs", "stateLookupNs", "instructions",
+};
+
+// bytes handed out by operator new on this thread, PhaseScope takes differences.
+// Counting them replaces the global operator new, which every allocation then
+// pays for whether stats are enabled or not, so it is only built with
+// -DSTATS_ALLOCATIONS; otherwise no allocations are reported.
+thread_local uint64_t statsAllocatedBytes = 0;
+
+#ifdef STATS_ALLOCATIONS
+const bool statsCountsAllocations = true;
+
+// out of line, so the compiler does not pair malloc/free across inlined new/delete
+__attribute__((noinline)) void *operator new(size_t n) {
+    statsAllocatedBytes += n;
+    void *p;
+    while (!(p = malloc(n ? n : 1))) {
+        new_handler handler = get_new_handler();
+        if (!handler) throw bad_alloc();
+        handler();
+    }
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+#else
+const bool statsCountsAllocations = false;
+#endif
+
+// small dense id of the calling thread, for trace events
+int statsThreadId() {
+    static atomic<int> nextId(0);
+    thread_local int id = nextId++;
+    return id;
+}
+
+double threadCpuMicros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// peak resident set of the process so far, in KiB
+long maxRssKiB() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Minimal JSON writer: nested objects and arrays of number/string fields, commas handled
+struct JsonWriter {
+    ostream &out;
+    vector<bool> first;     // per open object, no field written yet
+
+    JsonWriter(ostream &out) : out(out) {}
+
+    static void writeString(ostream &out, const string &value) {
+        out << "\"";
+        for (char c : value) {
+            if (c == '"' || c == '\\') out << '\\';
+            if ((unsigned char)c < 0x20) out << "\\u" << hex << setw(4) << setfill('0') << int(c) << dec << setfill(' ');
+            else out << c;
+        }
+        out << "\"";
+    }
+
+    void key(const string &name) {
+        if (!first.empty()) {
+            out << (first.back() ? "\n" : ",\n");
+            first.back() = false;
+        }
+        out << string(2 * first.size(), ' ');
+        if (!name.empty()) out << "\"" << name << "\": ";
+    }
+
+    void begin(const string &name = "", char bracket = '{') {
+        key(name);
+        out << bracket;
+        first.push_back(true);
+    }
+
+    void end(char bracket = '}') {
+        bool empty = first.back();
+        first.pop_back();
+        if (!empty) out << "\n" << string(2 * first.size(), ' ');
+        out << bracket;
+        if (first.empty()) out << "\n";
+    }
+
+    template <class T>
+    void field(const string &name, T value) {
+        key(name);
+        out << value;
+    }
+
+    void field(const string &name, const string &value) {
+        key(name);
+        writeString(out, value);
+    }
+
+    void field(const string &name, const char *value) {
+        field(name, string(value));
+    }
+
+    void field(const string &name, bool value) {
+        key(name);
+        out << (value ? "true" : "false");
+    }
+};
+
+struct PhaseRecord {
+    const char *name;
+    string detail;          // e.g. the file a batch phase compiled
+    int thread;
+    double start, wall;     // microseconds since stats were enabled
+    double cpu;             // microseconds of CPU time on the phase's thread
+    uint64_t allocated;     // bytes allocated on the phase's thread, if statsCountsAllocations
+};
+
+struct Stats {
+    bool enabled = false;
+    chrono::steady_clock::time_point origin;
+    atomic<uint64_t> counters[STAT_COUNT] = {};
+    mutex lock;
+    vector<PhaseRecord> phases;     // in the order they finished
+
+    void enable() {
+        origin = chrono::steady_clock::now();
+        enabled = true;
+    }
+
+    void add(StatCounter counter, uint64_t n) {
+        if (enabled) counters[counter].fetch_add(n, memory_order_relaxed);
+    }
+
+    double micros(chrono::steady_clock::time_point t) const {
+        return chrono::duration<double, micro>(t - origin).count();
+    }
+
+    void record(PhaseRecord &&phase) {
+        lock_guard<mutex> guard(lock);
+        phases.push_back(move(phase));
+    }
+
+    // totals per phase name in first-finished order, the counters, the peak RSS
+    void writeSummary(ostream &out) {
+        lock_guard<mutex> guard(lock);
+        struct Total {
+            size_t calls = 0;
+            double wall = 0, cpu = 0;
+            uint64_t allocated = 0;
+        };
+        vector<const char *> order;
+        unordered_map<string, Total> totals;
+        for (const PhaseRecord &p : phases) {
+            auto found = totals.find(p.name);
+            if (found == totals.end()) {
+                order.push_back(p.name);
+                found = totals.emplace(p.name, Total()).first;
+            }
+            Total &t = found->second;
+            t.calls++;
+            t.wall += p.wall;
+            t.cpu += p.cpu;
+            t.allocated += p.allocated;
+        }
+
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        double cpu = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+                     (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+
+        JsonWriter json(out);
+        json.begin();
+        json.field("wallSeconds", micros(chrono::steady_clock::now()) / 1e6);
+        json.field("cpuSeconds", cpu);
+        json.field("maxRssKiB", usage.ru_maxrss);
+        json.begin("phases", '[');
+        for (const char *name : order) {
+            const Total &t = totals[name];
+            json.begin();
+            json.field("name", name);
+            json.field("calls", t.calls);
+            json.field("wallSeconds", t.wall / 1e6);
+            json.field("cpuSeconds", t.cpu / 1e6);
+            if (statsCountsAllocations) json.field("allocatedBytes", t.allocated);
+            json.end();
+        }
+        json.end(']');
+        json.begin("counters");
+        for (int c = 0; c < STAT_COUNT; ++c) json.field(statCounterNames[c], counters[c].load());
+        json.end();
+        json.end();
+    }
+
+    // one complete ("X") event per phase, one event per line
+    void writeTrace(ostream &out) {
+        lock_guard<mutex> guard(lock);
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        out << fixed << setprecision(3);
+        for (size_t i = 0; i < phases.size(); ++i) {
+            const PhaseRecord &p = phases[i];
+            out << "{\"name\": ";
+            JsonWriter::writeString(out, p.name);
+            out << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << p.thread << ", \"ts\": " << p.start
+                << ", \"dur\": " << p.wall << ", \"args\": {\"cpuUs\": " << p.cpu;
+            if (statsCountsAllocations) out << ", \"allocatedBytes\": " << p.allocated;
+            if (!p.detail.empty()) {
+                out << ", \"detail\": ";
+                JsonWriter::writeString(out, p.detail);
+            }
+            out << "}}" << (i + 1 < phases.size() ? ",\n" : "\n");
+        }
+        out << defaultfloat << "]}\n";
+    }
+};
+
+Stats stats;
+
+// times the enclosing block as a phase named name, a string literal
+struct PhaseScope {
+    const char *name;
+    bool active;
+    string detail;
+    chrono::steady_clock::time_point start;
+    double cpuStart = 0;
+    uint64_t allocatedStart = 0;
+
+    explicit PhaseScope(const char *name, const string &detail = string()) : name(name), active(stats.enabled) {
+        if (!active) return;
+        this->detail = detail;
+        allocatedStart = statsAllocatedBytes;
+        cpuStart = threadCpuMicros();
+        start = chrono::steady_clock::now();
+    }
+
+    ~PhaseScope() {
+        if (!active) return;
+        auto end = chrono::steady_clock::now();
+        PhaseRecord phase{name, move(detail), statsThreadId(), stats.micros(start),
+                          chrono::duration<double, micro>(end - start).count(), threadCpuMicros() - cpuStart,
+                          statsAllocatedBytes - allocatedStart};
+        stats.record(move(phase));
+    }
+
+    PhaseScope(const PhaseScope&) = delete;
+    PhaseScope& operator=(const PhaseScope&) = delete;
+};
+
+// adds the nanoseconds the enclosing block took to counter
+struct StatTimer {
+    StatCounter counter;
+    bool active;
+    chrono::steady_clock::time_point start;
+
+    explicit StatTimer(StatCounter counter) : counter(counter), active(stats.enabled) {
+        if (active) start = chrono::steady_clock::now();
+    }
+
+    ~StatTimer() {
+        if (!active) return;
+        auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        stats.counters[counter].fetch_add(ns, memory_order_relaxed);
+    }
+};
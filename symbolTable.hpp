@@ -1,44 +1,426 @@
-#include <fstream> 
+#include <fstream>
+#include <charconv>
 
-struct SymbolInfo {
-    string name;
-    string type;
-    int row;
-    int col;
+using namespace std;
 
-    string toString() const {
-        return "<" + name + ", " + type + ", row: " + to_string(row) + ", col: " + to_string(col) + ">";
+// Symbol table with block scopes, fed the token stream of one file.
+//  - names are interned into a NameArena, identifiers are hashed once per file
+//  - scopes follow the blocks, INDENT opens a scope inside the current one
+//    and DEDENT closes it
+//  - an identifier followed by = defines the name, any other occurrence
+//    uses it. Both refer to the symbol of that name defined in the current
+//    scope or an enclosing one. If there is none, a symbol is created in the
+//    current scope, without a definition when it starts with a use.
+//  - every occurrence is kept in 12 bytes. finish() indexes them by symbol,
+//    so the references of a symbol are one contiguous range.
+// writeToFile lists the scopes, then the symbols in source order.
+
+static const uint32_t NO_ENTRY = UINT32_MAX;
+
+struct SymbolEntry {
+    uint32_t name;
+    uint32_t scope;
+    uint32_t firstOccurrence;
+};
+
+struct Occurrence {
+    uint32_t symbol;
+    uint32_t row;
+    uint32_t colAndKind;    // column << 1 | definition
+
+    uint32_t col() const { return colAndKind >> 1; }
+    bool isDefinition() const { return colAndKind & 1; }
+};
+
+struct Scope {
+    uint32_t parent;        // NO_ENTRY for the file scope
+    uint32_t firstRow, lastRow;
+};
+
+// Writes through a 64 KiB buffer instead of an ostream per field
+struct BufferedWriter {
+    int fd;
+    string buffer;
+    bool ok;
+
+    explicit BufferedWriter(const string &path) : fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)), ok(fd >= 0) {
+        buffer.reserve(1 << 16);
+    }
+
+    ~BufferedWriter() {
+        close();
+    }
+
+    void put(string_view s) {
+        buffer.append(s.data(), s.size());
+        if (buffer.size() >= (1 << 16)) flush();
+    }
+
+    void put(uint32_t n) {
+        char digits[16];
+        auto res = to_chars(digits, digits + sizeof(digits), n);
+        put(string_view(digits, res.ptr - digits));
+    }
+
+    void flush() {
+        size_t done = 0;
+        while (ok && done < buffer.size()) {
+            ssize_t n = ::write(fd, buffer.data() + done, buffer.size() - done);
+            if (n <= 0) ok = false;
+            else done += n;
+        }
+        buffer.clear();
+    }
+
+    // false if anything could not be written
+    bool close() {
+        if (fd < 0) return ok;
+        flush();
+        if (::close(fd) != 0) ok = false;
+        fd = -1;
+        return ok;
     }
 };
 
+// Interned names: one char buffer plus a 4 byte offset per name, found
+// through an open addressing table of (hash, id) slots. The lexer's symbol
+// ids are mapped to name ids on first sight, so an identifier token is only
+// hashed once per file.
+struct NameArena {
+    string chars;                               // name i is chars[nameStart[i] .. nameStart[i + 1])
+    vector<uint32_t> nameStart = {0};
+    vector<pair<uint32_t, uint32_t> > slots;    // (hash, name id), name id NO_ENTRY if free
+    vector<uint32_t> nameOfLexerSymbol;         // by the lexer's symbol id
+
+    NameArena() {
+        growSlots();
+    }
+
+    static uint32_t hashName(string_view s) {
+        uint32_t h = 2166136261u;
+        for (char c : s) h = (h ^ (unsigned char)c) * 16777619u;
+        return h;
+    }
+
+    void growSlots() {
+        vector<pair<uint32_t, uint32_t> > old;
+        old.swap(slots);
+        slots.assign(max<size_t>(64, 2 * old.size()), {0, NO_ENTRY});
+        size_t mask = slots.size() - 1;
+        for (const auto &slot : old) {
+            if (slot.second == NO_ENTRY) continue;
+            size_t i = slot.first & mask;
+            while (slots[i].second != NO_ENTRY) i = (i + 1) & mask;
+            slots[i] = slot;
+        }
+    }
+
+    size_t size() const {
+        return nameStart.size() - 1;
+    }
+
+    string_view name(uint32_t id) const {
+        return string_view(chars.data() + nameStart[id], nameStart[id + 1] - nameStart[id]);
+    }
+
+    uint32_t intern(string_view s) {
+        if (2 * (size() + 1) > slots.size()) growSlots();
+        uint32_t h = hashName(s);
+        size_t mask = slots.size() - 1;
+        for (size_t i = h & mask; ; i = (i + 1) & mask) {
+            if (slots[i].second == NO_ENTRY) {
+                uint32_t id = size();
+                chars.append(s.data(), s.size());
+                nameStart.push_back(chars.size());
+                slots[i] = {h, id};
+                return id;
+            }
+            if (slots[i].first == h && name(slots[i].second) == s) return slots[i].second;
+        }
+    }
+
+    // name id of an identifier or keyword token
+    uint32_t intern(const Token &tok, const Lexer &lexer) {
+        if (tok.symbol == NO_SYMBOL) return intern(lexer.lexeme(tok));
+        if (tok.symbol >= nameOfLexerSymbol.size()) nameOfLexerSymbol.resize(2 * tok.symbol + 16, NO_ENTRY);
+        uint32_t &id = nameOfLexerSymbol[tok.symbol];
+        if (id == NO_ENTRY) id = intern(lexer.lexeme(tok));
+        return id;
+    }
+
+    // name id of s, NO_ENTRY if it was never interned
+    uint32_t find(string_view s) const {
+        uint32_t h = hashName(s);
+        size_t mask = slots.size() - 1;
+        for (size_t i = h & mask; slots[i].second != NO_ENTRY; i = (i + 1) & mask) {
+            if (slots[i].first == h && name(slots[i].second) == s) return slots[i].second;
+        }
+        return NO_ENTRY;
+    }
+
+    // empty again, the buffers and the slot table keep their size for the next file
+    void clear() {
+        chars.clear();
+        nameStart.resize(1);
+        fill(slots.begin(), slots.end(), make_pair(0u, NO_ENTRY));
+        nameOfLexerSymbol.clear();
+    }
+
+    // lexer symbol ids restart with every file
+    void forgetLexerSymbols() {
+        nameOfLexerSymbol.clear();
+    }
+
+    size_t bytes() const {
+        return chars.capacity() + nameStart.capacity() * sizeof(uint32_t) + slots.capacity() * sizeof(slots[0]) +
+               nameOfLexerSymbol.capacity() * sizeof(uint32_t);
+    }
+};
 
 class SymbolTable {
 private:
-    unordered_map<string, SymbolInfo> table;
+    NameArena names;
+
+    vector<SymbolEntry> symbols;
+    vector<Occurrence> occurrences;
+    vector<Scope> scopes;
+
+    // resolution state while tokens are fed
+    vector<uint32_t> visible;       // by name id, the visible symbol of that name
+    vector<uint32_t> openSymbols;   // symbols of the open scopes, innermost last
+    vector<uint32_t> openMarks;     // openSymbols.size() when each open scope began
+    uint32_t current = NO_ENTRY;
+    uint32_t lastRow = 0;
+    bool havePending = false;
+    uint32_t pendingName = 0, pendingRow = 0, pendingCol = 0;
+
+    // filled by finish(): occurrence ids grouped by symbol, symbol ids grouped by name
+    vector<uint32_t> refStart, refs;
+    vector<uint32_t> byNameStart, byName;
+
+    void openScope(uint32_t row) {
+        scopes.push_back({current, row, row});
+        current = scopes.size() - 1;
+        openMarks.push_back(openSymbols.size());
+    }
+
+    // names defined in the scope are not visible past its end
+    void closeScope() {
+        for (size_t i = openMarks.back(); i < openSymbols.size(); ++i) visible[symbols[openSymbols[i]].name] = NO_ENTRY;
+        openSymbols.resize(openMarks.back());
+        openMarks.pop_back();
+        scopes[current].lastRow = lastRow;
+        current = scopes[current].parent;
+    }
+
+    void addOccurrence(uint32_t nameId, uint32_t row, uint32_t col, bool definition) {
+        uint32_t sym = visible[nameId];
+        if (sym == NO_ENTRY) {
+            sym = symbols.size();
+            symbols.push_back({nameId, current, uint32_t(occurrences.size())});
+            visible[nameId] = sym;
+            openSymbols.push_back(sym);
+        }
+        occurrences.push_back({sym, row, col << 1 | uint32_t(definition)});
+    }
 
 public:
-    void addSymbol(const Token &token) {
-        if (token.type == "IDENTIFIER") {
-            if (table.find(token.lexeme) == table.end()) {
-                table[token.lexeme] = {token.lexeme, token.type, token.rowNum, token.colNum};
+    SymbolTable() {
+        openScope(0);
+    }
+
+    string_view name(uint32_t nameId) const {
+        return names.name(nameId);
+    }
+
+    // name id of s, NO_ENTRY if no identifier of that name was seen
+    uint32_t findName(string_view s) const {
+        return names.find(s);
+    }
+
+    // feed every token of the file in order, then call finish()
+    void add(const Token &tok, Lexer &lexer) {
+        if (havePending) {
+            bool definition = tok.kind == TK_OPERATOR && lexer.lexeme(tok) == "=";
+            addOccurrence(pendingName, pendingRow, pendingCol, definition);
+            havePending = false;
+        }
+        int row, col;
+        switch (tok.kind) {
+        case TK_IDENTIFIER:
+            pendingName = names.intern(tok, lexer);
+            if (pendingName == visible.size()) visible.push_back(NO_ENTRY);
+            lexer.position(tok, row, col);
+            pendingRow = lastRow = row;
+            pendingCol = col;
+            havePending = true;
+            break;
+        case TK_INDENT:
+            lexer.position(tok, row, col);
+            openScope(row);
+            break;
+        case TK_DEDENT:
+            if (openMarks.size() > 1) closeScope();
+            break;
+        case TK_NEWLINE:
+            lexer.position(tok, row, col);
+            lastRow = row;
+            break;
+        default:
+            break;
+        }
+    }
+
+    // flushes the last identifier and closes the scopes, then builds the reference index
+    void finish() {
+        if (havePending) {
+            addOccurrence(pendingName, pendingRow, pendingCol, false);
+            havePending = false;
+        }
+        while (openMarks.size() > 1) closeScope();
+        scopes[0].lastRow = lastRow;
+
+        // counting sort keeps source order within a symbol
+        refStart.assign(symbols.size() + 1, 0);
+        for (const Occurrence &o : occurrences) refStart[o.symbol + 1]++;
+        for (size_t s = 0; s < symbols.size(); ++s) refStart[s + 1] += refStart[s];
+        refs.resize(occurrences.size());
+        vector<uint32_t> fill(refStart.begin(), refStart.end() - 1);
+        for (uint32_t i = 0; i < occurrences.size(); ++i) refs[fill[occurrences[i].symbol]++] = i;
+
+        size_t numNames = names.size();
+        byNameStart.assign(numNames + 1, 0);
+        for (const SymbolEntry &s : symbols) byNameStart[s.name + 1]++;
+        for (size_t n = 0; n < numNames; ++n) byNameStart[n + 1] += byNameStart[n];
+        byName.resize(symbols.size());
+        fill.assign(byNameStart.begin(), byNameStart.end() - 1);
+        for (uint32_t s = 0; s < symbols.size(); ++s) byName[fill[symbols[s].name]++] = s;
+    }
+
+    size_t size() const {
+        return symbols.size();
+    }
+
+    const SymbolEntry &symbol(uint32_t s) const {
+        return symbols[s];
+    }
+
+    const Occurrence &occurrence(uint32_t i) const {
+        return occurrences[i];
+    }
+
+    const Scope &scope(uint32_t id) const {
+        return scopes[id];
+    }
+
+    // occurrence ids of symbol s in source order, after finish()
+    pair<const uint32_t*, const uint32_t*> references(uint32_t s) const {
+        return {refs.data() + refStart[s], refs.data() + refStart[s + 1]};
+    }
+
+    // symbols of a name in source order, one per scope that defines it, after finish()
+    pair<const uint32_t*, const uint32_t*> symbolsNamed(uint32_t nameId) const {
+        return {byName.data() + byNameStart[nameId], byName.data() + byNameStart[nameId + 1]};
+    }
+
+    // the symbol a use of s in scope id refers to, NO_ENTRY if none of the enclosing scopes has one
+    uint32_t lookup(string_view s, uint32_t id) const {
+        uint32_t nameId = findName(s);
+        if (nameId == NO_ENTRY) return NO_ENTRY;
+        auto range = symbolsNamed(nameId);
+        for (; id != NO_ENTRY; id = scopes[id].parent) {
+            for (const uint32_t *it = range.first; it != range.second; ++it) {
+                if (symbols[*it].scope == id) return *it;
             }
         }
+        return NO_ENTRY;
+    }
+
+    bool hasDefinition(uint32_t s) const {
+        auto range = references(s);
+        for (const uint32_t *it = range.first; it != range.second; ++it) {
+            if (occurrences[*it].isDefinition()) return true;
+        }
+        return false;
     }
 
-    void writeToFile(const string &filename = "symboltable.txt") const {
-        ofstream outFile(filename);
-        if (!outFile.is_open()) {
+    // Symbol Table:
+    // scope 1 in 0: rows 2-4
+    // <x, IDENTIFIER, row: 0, col: 0> scope 0: def 0:0, use 3:8
+    bool writeToFile(const string &filename = "symboltable.txt") const {
+        BufferedWriter out(filename);
+        if (!out.ok) {
             cerr << "Error: Could not open file " << filename << " for writing.\n";
-            return;
+            return false;
         }
 
-        outFile << "Symbol Table:\n";
-        for (const auto &entry : table) {
-            const SymbolInfo &info = entry.second;
-            outFile << "<" << info.name << ", " << info.type
-                    << ", row: " << info.row << ", col: " << info.col << ">\n";
+        out.put("Symbol Table:\n");
+        for (uint32_t id = 0; id < scopes.size(); ++id) {
+            out.put("scope ");
+            out.put(id);
+            if (scopes[id].parent != NO_ENTRY) {
+                out.put(" in ");
+                out.put(scopes[id].parent);
+            }
+            out.put(": rows ");
+            out.put(scopes[id].firstRow);
+            out.put("-");
+            out.put(scopes[id].lastRow);
+            out.put("\n");
+        }
+        for (uint32_t s = 0; s < symbols.size(); ++s) {
+            const Occurrence &first = occurrences[symbols[s].firstOccurrence];
+            out.put("<");
+            out.put(name(symbols[s].name));
+            out.put(", IDENTIFIER, row: ");
+            out.put(first.row);
+            out.put(", col: ");
+            out.put(first.col());
+            out.put("> scope ");
+            out.put(symbols[s].scope);
+            out.put(":");
+            auto range = references(s);
+            for (const uint32_t *it = range.first; it != range.second; ++it) {
+                const Occurrence &o = occurrences[*it];
+                out.put(it == range.first ? " " : ", ");
+                out.put(o.isDefinition() ? "def " : "use ");
+                out.put(o.row);
+                out.put(":");
+                out.put(o.col());
+            }
+            out.put("\n");
+        }
+        if (!out.close()) {
+            cerr << "Error: Could not write " << filename << "\n";
+            return false;
         }
+        return true;
+    }
+};
+
+// A token source for BasicLRParser::parseTokens that feeds the tokens of
+// another one (the lexer itself, or LexedTokens) to a symbol table on the way,
+// so the parse is the symbol table's pass over the file too. drain() takes
+// the tokens the parser left after an error and finishes the table.
+template <class Tokens>
+struct SymbolFeed {
+    Tokens &tokens;
+    Lexer &lexer;
+    SymbolTable &symbols;
+
+    SymbolFeed(Tokens &tokens, Lexer &lexer, SymbolTable &symbols) : tokens(tokens), lexer(lexer), symbols(symbols) {}
+
+    bool next(Token &tok) {
+        if (!tokens.next(tok)) return false;
+        symbols.add(tok, lexer);
+        return true;
+    }
 
-        outFile.close();
+    // false when the lexer failed (Lexer::error says why)
+    bool drain() {
+        Token tok;
+        while (next(tok)) {}
+        symbols.finish();
+        return !lexer.failed();
     }
 };
@@ -0,0 +1,215 @@
+
+using namespace std;
+
+// On-disk cache of built ParseTables, so a run whose grammar did not change
+// maps the tables instead of rebuilding the LR collection.
+//
+// The file is a fixed header followed by int32 arrays, written in the order
+//   actions: base, fallback, next, check   gotos: base, fallback, next, check
+//   prodLhs, prodLength, then the symbol names, NUL terminated and padded to 4
+// The comb arrays are used in place from the mapping, the small arrays are
+// copied. A file is only used when its magic, version, mode and grammar hash
+// match, its size matches the header, the payload hash matches and every
+// table entry is in range; otherwise the caller rebuilds and rewrites it.
+
+static constexpr char TABLE_CACHE_MAGIC[8] = {'L', 'R', 'T', 'A', 'B', 'L', 'E', 'S'};
+static constexpr uint32_t TABLE_CACHE_VERSION = 1;
+
+struct TableCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t mode;
+    uint64_t grammarHash;
+    uint64_t payloadHash;
+    uint32_t numTerminals, numNonTerminals, numStates, numProductions;
+    uint32_t endMarker;
+    uint32_t actionSlots, gotoSlots;
+    uint32_t namesBytes;
+};
+
+// FNV-1a, also used over the payload to catch corrupt files
+uint64_t hashBytes(const char *data, size_t n, uint64_t h = 0xcbf29ce484222325ULL) {
+    for (size_t i = 0; i < n; ++i) {
+        h ^= (unsigned char)data[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// hash of the grammar file's contents, false if it cannot be read
+bool grammarFileHash(const string &path, uint64_t &hash) {
+    ifstream in(path, ios::binary);
+    if (!in) return false;
+    string contents((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    hash = hashBytes(contents.data(), contents.size());
+    return true;
+}
+
+// grammar.txt → grammar.txt.lr1.tables / grammar.txt.lalr.tables
+string tableCachePath(const string &grammarFile, LRMode mode) {
+    return grammarFile + (mode == LR_LALR ? ".lalr" : ".lr1") + ".tables";
+}
+
+// writes to a temporary file and renames it over path, so readers never see a partial file
+bool saveParseTables(const ParseTables &tables, const string &path, uint64_t grammarHash, LRMode mode) {
+    PhaseScope phase("save table cache");
+    string payload;
+    auto append = [&](const int32_t *data, size_t n) { payload.append((const char *)data, n * sizeof(int32_t)); };
+    append(tables.actions.baseAt, tables.actions.rows);
+    append(tables.actions.fallbackAt, tables.actions.rows);
+    append(tables.actions.nextAt, tables.actions.slots);
+    append(tables.actions.checkAt, tables.actions.slots);
+    append(tables.gotos.baseAt, tables.gotos.rows);
+    append(tables.gotos.fallbackAt, tables.gotos.rows);
+    append(tables.gotos.nextAt, tables.gotos.slots);
+    append(tables.gotos.checkAt, tables.gotos.slots);
+    vector<int32_t> prodLhs(tables.prodLhs.begin(), tables.prodLhs.end());
+    vector<int32_t> prodLength(tables.prodLength.begin(), tables.prodLength.end());
+    append(prodLhs.data(), prodLhs.size());
+    append(prodLength.data(), prodLength.size());
+    size_t namesStart = payload.size();
+    for (const string &name : tables.symbolNames) payload.append(name.c_str(), name.size() + 1);
+    while (payload.size() % 4) payload.push_back('\0');
+
+    TableCacheHeader header;
+    memcpy(header.magic, TABLE_CACHE_MAGIC, sizeof(header.magic));
+    header.version = TABLE_CACHE_VERSION;
+    header.mode = mode;
+    header.grammarHash = grammarHash;
+    header.payloadHash = hashBytes(payload.data(), payload.size());
+    header.numTerminals = tables.numTerminals;
+    header.numNonTerminals = tables.numNonTerminals;
+    header.numStates = tables.numStates;
+    header.numProductions = tables.prodLhs.size();
+    header.endMarker = tables.endMarker;
+    header.actionSlots = tables.actions.slots;
+    header.gotoSlots = tables.gotos.slots;
+    header.namesBytes = payload.size() - namesStart;
+
+    string tmp = path + ".tmp" + to_string(getpid());
+    {
+        ofstream out(tmp, ios::binary | ios::trunc);
+        if (!out) return false;
+        out.write((const char *)&header, sizeof(header));
+        out.write(payload.data(), payload.size());
+        if (!out) {
+            out.close();
+            unlink(tmp.c_str());
+            return false;
+        }
+    }
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// every value a lookup can return or index with is in range
+bool validTables(const ParseTables &t) {
+    const CombTable &act = t.actions, &go = t.gotos;
+    for (size_t r = 0; r < act.rows; ++r) {
+        if (act.baseAt[r] < 0 || size_t(act.baseAt[r]) + t.numTerminals > act.slots) return false;
+        int32_t v = act.fallbackAt[r];
+        if (v > 0 || -int64_t(v) > int64_t(t.prodLhs.size())) return false;   // defaults are reductions or error
+    }
+    for (size_t i = 0; i < act.slots; ++i) {
+        int32_t v = act.nextAt[i];
+        if (act.checkAt[i] < -1 || act.checkAt[i] >= t.numStates) return false;
+        if (v > t.numStates || -int64_t(v) > int64_t(t.prodLhs.size())) return false;
+    }
+    for (size_t r = 0; r < go.rows; ++r) {
+        if (go.baseAt[r] < 0 || size_t(go.baseAt[r]) + t.numStates > go.slots) return false;
+        if (go.fallbackAt[r] < -1 || go.fallbackAt[r] >= t.numStates) return false;
+    }
+    for (size_t i = 0; i < go.slots; ++i) {
+        if (go.checkAt[i] < -1 || go.checkAt[i] >= t.numNonTerminals) return false;
+        if (go.nextAt[i] < -1 || go.nextAt[i] >= t.numStates) return false;
+    }
+    int numSymbols = t.numTerminals + t.numNonTerminals;
+    for (size_t p = 0; p < t.prodLhs.size(); ++p) {
+        if (t.prodLhs[p] < t.numTerminals || t.prodLhs[p] >= numSymbols || t.prodLength[p] < 0) return false;
+    }
+    return t.endMarker >= 0 && t.endMarker < t.numTerminals && int(t.symbolNames.size()) == numSymbols;
+}
+
+// maps path into tables, false with why filled in when it is missing, stale or corrupt
+bool loadParseTables(ParseTables &tables, const string &path, uint64_t grammarHash, LRMode mode, string &why) {
+    PhaseScope phase("load table cache");
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        why = "no cache file";
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(TableCacheHeader)) {
+        close(fd);
+        why = "truncated header";
+        return false;
+    }
+    size_t size = st.st_size;
+    void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        why = "mmap failed";
+        return false;
+    }
+    // tables may already view the mapping when a late check fails, the caller rebuilds them
+    auto fail = [&](const char *reason) {
+        tables.actions.view(nullptr, nullptr, nullptr, nullptr, 0, 0);
+        tables.gotos.view(nullptr, nullptr, nullptr, nullptr, 0, 0);
+        munmap(map, size);
+        why = reason;
+        return false;
+    };
+
+    const TableCacheHeader &h = *(const TableCacheHeader *)map;
+    if (memcmp(h.magic, TABLE_CACHE_MAGIC, sizeof(h.magic)) != 0) return fail("bad magic");
+    if (h.version != TABLE_CACHE_VERSION) return fail("format version changed");
+    if (h.mode != uint32_t(mode)) return fail("built for another mode");
+    if (h.grammarHash != grammarHash) return fail("grammar changed");
+
+    size_t ints = 2 * size_t(h.numStates) + 2 * size_t(h.actionSlots) + 2 * size_t(h.numNonTerminals) +
+                  2 * size_t(h.gotoSlots) + 2 * size_t(h.numProductions);
+    if (size != sizeof(TableCacheHeader) + ints * sizeof(int32_t) + h.namesBytes) return fail("size mismatch");
+    const char *payload = (const char *)map + sizeof(TableCacheHeader);
+    if (hashBytes(payload, size - sizeof(TableCacheHeader)) != h.payloadHash) return fail("payload hash mismatch");
+
+    const int32_t *p = (const int32_t *)payload;
+    auto take = [&](size_t n) {
+        const int32_t *start = p;
+        p += n;
+        return start;
+    };
+    tables.numStates = h.numStates;
+    tables.numTerminals = h.numTerminals;
+    tables.numNonTerminals = h.numNonTerminals;
+    tables.endMarker = h.endMarker;
+    const int32_t *base = take(h.numStates), *fallback = take(h.numStates);
+    const int32_t *next = take(h.actionSlots), *check = take(h.actionSlots);
+    tables.actions.view(base, fallback, next, check, h.numStates, h.actionSlots);
+    base = take(h.numNonTerminals);
+    fallback = take(h.numNonTerminals);
+    next = take(h.gotoSlots);
+    check = take(h.gotoSlots);
+    tables.gotos.view(base, fallback, next, check, h.numNonTerminals, h.gotoSlots);
+    const int32_t *lhs = take(h.numProductions), *len = take(h.numProductions);
+    tables.prodLhs.assign(lhs, lhs + h.numProductions);
+    tables.prodLength.assign(len, len + h.numProductions);
+
+    tables.symbolNames.clear();
+    const char *name = (const char *)p, *namesEnd = name + h.namesBytes;
+    while (tables.symbolNames.size() < h.numTerminals + h.numNonTerminals) {
+        const char *end = (const char *)memchr(name, '\0', namesEnd - name);
+        if (!end) return fail("bad symbol names");
+        tables.symbolNames.emplace_back(name, end);
+        name = end + 1;
+    }
+    tables.conflicts.clear();
+
+    if (!validTables(tables)) return fail("table entries out of range");
+    if (tables.mapped) munmap(tables.mapped, tables.mappedSize);
+    tables.mapped = map;
+    tables.mappedSize = size;
+    return true;
+}
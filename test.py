@@ -3,7 +3,7 @@ c=True
 a=1
 b=3.4
 print(a)
-if a = 2 :
+if a == 2 :
     print('HELLO')
     print('BYE')
 else:
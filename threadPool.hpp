@@ -0,0 +1,101 @@
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+// Fixed size pool of worker threads draining a shared task queue
+struct ThreadPool {
+	vector<thread> workers;
+	queue<function<void()>> tasks;
+	mutex lock;
+	condition_variable taskReady;
+	condition_variable allDone;
+	size_t running = 0;
+	bool stopping = false;
+
+	explicit ThreadPool(unsigned count = 0) {
+	    if (count == 0) count = max(1u, thread::hardware_concurrency());
+	    for (unsigned i = 0; i < count; ++i) {
+	        workers.emplace_back([this] { workerLoop(); });
+	    }
+	}
+
+	~ThreadPool() {
+	    {
+	        unique_lock<mutex> guard(lock);
+	        stopping = true;
+	    }
+	    taskReady.notify_all();
+	    for (thread &t : workers) t.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	size_t size() const {
+	    return workers.size();
+	}
+
+	void submit(function<void()> task) {
+	    {
+	        unique_lock<mutex> guard(lock);
+	        tasks.push(move(task));
+	    }
+	    taskReady.notify_one();
+	}
+
+	// block until every submitted task has finished
+	void wait() {
+	    unique_lock<mutex> guard(lock);
+	    allDone.wait(guard, [this] { return tasks.empty() && running == 0; });
+	}
+
+	// run body(i) for i in [0, n) on the pool and wait for all of them
+	// only waits for its own tasks, so several callers can share the pool
+	// an exception from body is caught on the worker, and the first one is
+	// rethrown here once every task has finished
+	void parallelFor(size_t n, const function<void(size_t)> &body) {
+	    mutex doneLock;
+	    condition_variable done;
+	    size_t left = n;
+	    exception_ptr failure;
+	    for (size_t i = 0; i < n; ++i) {
+	        submit([&, i] {
+	            exception_ptr caught;
+	            try {
+	                body(i);
+	            } catch (...) {
+	                caught = current_exception();
+	            }
+	            unique_lock<mutex> guard(doneLock);
+	            if (caught && !failure) failure = caught;
+	            if (--left == 0) done.notify_all();
+	        });
+	    }
+	    unique_lock<mutex> guard(doneLock);
+	    done.wait(guard, [&] { return left == 0; });
+	    if (failure) rethrow_exception(failure);
+	}
+
+	void workerLoop() {
+	    while (true) {
+	        function<void()> task;
+	        {
+	            unique_lock<mutex> guard(lock);
+	            taskReady.wait(guard, [this] { return stopping || !tasks.empty(); });
+	            if (tasks.empty()) return;
+	            task = move(tasks.front());
+	            tasks.pop();
+	            running++;
+	        }
+	        task();
+	        {
+	            unique_lock<mutex> guard(lock);
+	            running--;
+	            if (tasks.empty() && running == 0) allDone.notify_all();
+	        }
+	    }
+	}
+};
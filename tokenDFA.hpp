@@ -0,0 +1,385 @@
+
+using namespace std;
+
+// Compiles the ordered list of token regexes used by the lexer into a single
+// minimized DFA, so that a line can be scanned in one pass instead of trying
+// every std::regex at every column.
+//
+// Only the subset of ECMAScript syntax used by the lexer patterns is supported:
+// literals, escapes (\d \w \s \b and escaped metacharacters), '.', character
+// classes with ranges and negation, groups, alternation and the * + ? operators.
+//
+// \b is handled exactly: a DFA state remembers whether the previous byte was a
+// word character, and the accept table is indexed by whether the next byte is
+// one. The start of the scanned text counts as a non-word position, which is
+// what regex_search on line.substr(i) did before.
+
+struct TokenDFA {
+	static constexpr int DEAD = 0;
+
+	int start = DEAD;
+	int numStates = 0;
+	int numClasses = 0;
+	uint8_t byteClass[256];
+	bool wordByte[256];
+	vector<int> next;         // numStates * numClasses transition table
+	vector<int> accept;       // numStates * 2, indexed by [state][next byte is a word char], -1 if none
+
+	// compile the ordered (pattern, type) list, earlier patterns win ties
+	void build(const vector<string>& patterns);
+
+	// longest match starting at pos, ties broken by pattern order
+	// returns the match length (0 if nothing matched) and sets pattern
+	int match(const char* s, size_t n, size_t pos, int& pattern) const {
+	    int state = start;
+	    int bestLen = 0;
+	    pattern = -1;
+	    for (size_t j = pos; ; ++j) {
+	        int nextWord = (j < n) ? wordByte[(uint8_t)s[j]] : 0;
+	        int p = accept[state * 2 + nextWord];
+	        if (p >= 0 && j > pos) {
+	            bestLen = (int)(j - pos);
+	            pattern = p;
+	        }
+	        if (j == n) break;
+	        state = next[state * numClasses + byteClass[(uint8_t)s[j]]];
+	        if (state == DEAD) break;
+	    }
+	    return bestLen;
+	}
+};
+
+
+// Thompson NFA used while building the DFA
+struct RegexNFA {
+	struct Node {
+	    vector<int> eps;
+	    int boundaryTo = -1;     // zero-width \b edge
+	    bitset<256> chars;
+	    int charTo = -1;
+	    int accept = -1;         // pattern index if this is a final node
+	};
+
+	struct Frag {
+	    int s, e;
+	};
+
+	vector<Node> nodes;
+	vector<bitset<256>> charSets;  // every character set used, for byte class refinement
+	string src;
+	size_t pos = 0;
+
+	int newNode() {
+	    nodes.emplace_back();
+	    return (int)nodes.size() - 1;
+	}
+
+	static bitset<256> wordSet() {
+	    bitset<256> b;
+	    for (int c = 0; c < 256; ++c) if (isalnum(c) || c == '_') b.set(c);
+	    return b;
+	}
+
+	static bitset<256> digitSet() {
+	    bitset<256> b;
+	    for (int c = '0'; c <= '9'; ++c) b.set(c);
+	    return b;
+	}
+
+	static bitset<256> spaceSet() {
+	    bitset<256> b;
+	    for (char c : string(" \t\n\r\f\v")) b.set((uint8_t)c);
+	    return b;
+	}
+
+	[[noreturn]] void fail(const string& why) {
+	    throw runtime_error("unsupported token regex '" + src + "': " + why);
+	}
+
+	Frag charFrag(const bitset<256>& set) {
+	    Frag f{newNode(), newNode()};
+	    nodes[f.s].chars = set;
+	    nodes[f.s].charTo = f.e;
+	    charSets.push_back(set);
+	    return f;
+	}
+
+	Frag emptyFrag() {
+	    Frag f{newNode(), newNode()};
+	    nodes[f.s].eps.push_back(f.e);
+	    return f;
+	}
+
+	// escape after a backslash, shared by atoms and character classes
+	bitset<256> escapeSet(char c) {
+	    if (c == 'd') return digitSet();
+	    if (c == 'w') return wordSet();
+	    if (c == 's') return spaceSet();
+	    if (c == 'D') return ~digitSet();
+	    if (c == 'W') return ~wordSet();
+	    if (c == 'S') return ~spaceSet();
+	    if (isalnum((uint8_t)c)) fail(string("escape \\") + c);
+	    bitset<256> b;
+	    b.set((uint8_t)c);
+	    return b;
+	}
+
+	bitset<256> parseClass() {
+	    // pos is just past '['
+	    bool negate = false;
+	    bitset<256> set;
+	    if (pos < src.size() && src[pos] == '^') { negate = true; pos++; }
+	    bool first = true;
+	    while (pos < src.size() && (src[pos] != ']' || first)) {
+	        first = false;
+	        bitset<256> item;
+	        int lo = -1;
+	        if (src[pos] == '\\') {
+	            if (++pos >= src.size()) fail("dangling escape");
+	            item = escapeSet(src[pos++]);
+	            if (item.count() == 1) for (int c = 0; c < 256; ++c) if (item[c]) lo = c;
+	        } else {
+	            lo = (uint8_t)src[pos++];
+	            item.set(lo);
+	        }
+	        // range a-z
+	        if (lo >= 0 && pos + 1 < src.size() && src[pos] == '-' && src[pos + 1] != ']') {
+	            pos++;
+	            int hi = (uint8_t)src[pos++];
+	            if (hi == '\\') {
+	                if (pos >= src.size()) fail("dangling escape");
+	                hi = (uint8_t)src[pos++];
+	            }
+	            if (hi < lo) fail("bad range");
+	            for (int c = lo; c <= hi; ++c) item.set(c);
+	        }
+	        set |= item;
+	    }
+	    if (pos >= src.size()) fail("unterminated class");
+	    pos++; // ']'
+	    return negate ? ~set : set;
+	}
+
+	Frag parseAtom() {
+	    char c = src[pos++];
+	    if (c == '(') {
+	        Frag f = parseAlt();
+	        if (pos >= src.size() || src[pos] != ')') fail("unbalanced parenthesis");
+	        pos++;
+	        return f;
+	    }
+	    if (c == '[') return charFrag(parseClass());
+	    if (c == '.') {
+	        bitset<256> b;
+	        b.set();
+	        b.reset('\n');
+	        b.reset('\r');
+	        return charFrag(b);
+	    }
+	    if (c == '\\') {
+	        if (pos >= src.size()) fail("dangling escape");
+	        char e = src[pos++];
+	        if (e == 'b') {
+	            Frag f{newNode(), newNode()};
+	            nodes[f.s].boundaryTo = f.e;
+	            return f;
+	        }
+	        return charFrag(escapeSet(e));
+	    }
+	    if (c == '*' || c == '+' || c == '?' || c == ')' || c == '|') fail(string("unexpected '") + c + "'");
+	    bitset<256> b;
+	    b.set((uint8_t)c);
+	    return charFrag(b);
+	}
+
+	Frag parseRepeat() {
+	    Frag f = parseAtom();
+	    while (pos < src.size() && (src[pos] == '*' || src[pos] == '+' || src[pos] == '?')) {
+	        char op = src[pos++];
+	        Frag r{newNode(), newNode()};
+	        nodes[r.s].eps.push_back(f.s);
+	        if (op != '+') nodes[r.s].eps.push_back(r.e);
+	        if (op != '?') nodes[f.e].eps.push_back(f.s);
+	        nodes[f.e].eps.push_back(r.e);
+	        f = r;
+	    }
+	    return f;
+	}
+
+	Frag parseConcat() {
+	    Frag f = emptyFrag();
+	    while (pos < src.size() && src[pos] != '|' && src[pos] != ')') {
+	        Frag g = parseRepeat();
+	        nodes[f.e].eps.push_back(g.s);
+	        f.e = g.e;
+	    }
+	    return f;
+	}
+
+	Frag parseAlt() {
+	    Frag f = parseConcat();
+	    while (pos < src.size() && src[pos] == '|') {
+	        pos++;
+	        Frag g = parseConcat();
+	        Frag r{newNode(), newNode()};
+	        nodes[r.s].eps = {f.s, g.s};
+	        nodes[f.e].eps.push_back(r.e);
+	        nodes[g.e].eps.push_back(r.e);
+	        f = r;
+	    }
+	    return f;
+	}
+
+	// adds pattern to the NFA and returns its start node
+	int addPattern(const string& pattern, int index) {
+	    src = pattern;
+	    pos = 0;
+	    Frag f = parseAlt();
+	    if (pos != src.size()) fail("unbalanced parenthesis");
+	    nodes[f.e].accept = index;
+	    return f.s;
+	}
+};
+
+
+void TokenDFA::build(const vector<string>& patterns) {
+    RegexNFA nfa;
+    int nfaStart = nfa.newNode();
+    for (int i = 0; i < (int)patterns.size(); ++i) {
+        int patternStart = nfa.addPattern(patterns[i], i);
+        nfa.nodes[nfaStart].eps.push_back(patternStart);
+    }
+
+    // 1) split the byte alphabet into classes that no char set distinguishes
+    bitset<256> wordSet = RegexNFA::wordSet();
+    for (int c = 0; c < 256; ++c) wordByte[c] = wordSet[c];
+    nfa.charSets.push_back(wordSet);
+
+    vector<int> cls(256, 0);
+    int classCount = 1;
+    for (const bitset<256>& set : nfa.charSets) {
+        map<pair<int, bool>, int> remap;
+        for (int c = 0; c < 256; ++c) {
+            auto key = make_pair(cls[c], (bool)set[c]);
+            auto it = remap.find(key);
+            if (it == remap.end()) it = remap.emplace(key, (int)remap.size()).first;
+            cls[c] = it->second;
+        }
+        classCount = remap.size();
+    }
+    vector<int> classRep(classCount);
+    for (int c = 255; c >= 0; --c) classRep[cls[c]] = c;
+
+    // 2) subset construction, a DFA state being (NFA node set, previous byte was a word char)
+    auto closure = [&](const vector<int>& set, bool prevWord, bool nextWord) {
+        vector<char> seen(nfa.nodes.size(), 0);
+        vector<int> stack(set), out;
+        for (int s : set) seen[s] = 1;
+        while (!stack.empty()) {
+            int s = stack.back();
+            stack.pop_back();
+            out.push_back(s);
+            const RegexNFA::Node& nd = nfa.nodes[s];
+            for (int t : nd.eps) if (!seen[t]) { seen[t] = 1; stack.push_back(t); }
+            if (nd.boundaryTo >= 0 && prevWord != nextWord && !seen[nd.boundaryTo]) {
+                seen[nd.boundaryTo] = 1;
+                stack.push_back(nd.boundaryTo);
+            }
+        }
+        return out;
+    };
+
+    map<pair<vector<int>, bool>, int> subsetId;
+    vector<pair<vector<int>, bool>> subsets;
+    vector<int> rawNext, rawAccept;
+
+    auto intern = [&](vector<int> set, bool prevWord) {
+        sort(set.begin(), set.end());
+        auto key = make_pair(set, prevWord);
+        auto it = subsetId.find(key);
+        if (it != subsetId.end()) return it->second;
+        int id = subsets.size();
+        subsetId.emplace(key, id);
+        subsets.push_back(key);
+        return id;
+    };
+
+    intern({}, false);                // raw state 0: dead
+    int rawStart = intern({nfaStart}, false);
+
+    for (size_t id = 0; id < subsets.size(); ++id) {
+        vector<int> set = subsets[id].first;
+        bool prevWord = subsets[id].second;
+
+        for (int nextWord = 0; nextWord < 2; ++nextWord) {
+            int best = -1;
+            for (int s : closure(set, prevWord, nextWord)) {
+                int a = nfa.nodes[s].accept;
+                if (a >= 0 && (best < 0 || a < best)) best = a;
+            }
+            rawAccept.push_back(best);
+        }
+
+        for (int k = 0; k < classCount; ++k) {
+            int c = classRep[k];
+            vector<int> moved;
+            for (int s : closure(set, prevWord, wordByte[c])) {
+                const RegexNFA::Node& nd = nfa.nodes[s];
+                if (nd.charTo >= 0 && nd.chars[c]) moved.push_back(nd.charTo);
+            }
+            moved.erase(unique((sort(moved.begin(), moved.end()), moved.begin()), moved.end()), moved.end());
+            int target = moved.empty() ? 0 : intern(moved, wordByte[c]);
+            rawNext.push_back(target);
+        }
+    }
+
+    // 3) Moore minimization, starting from the partition by accept behaviour
+    int n = subsets.size();
+    vector<int> block(n);
+    {
+        map<pair<int, int>, int> ids;
+        for (int s = 0; s < n; ++s) {
+            auto key = make_pair(rawAccept[s * 2], rawAccept[s * 2 + 1]);
+            auto it = ids.find(key);
+            if (it == ids.end()) it = ids.emplace(key, (int)ids.size()).first;
+            block[s] = it->second;
+        }
+    }
+    int blockCount = 0;
+    while (true) {
+        map<vector<int>, int> ids;
+        vector<int> refined(n);
+        for (int s = 0; s < n; ++s) {
+            vector<int> sig;
+            sig.reserve(classCount + 1);
+            sig.push_back(block[s]);
+            for (int k = 0; k < classCount; ++k) sig.push_back(block[rawNext[s * classCount + k]]);
+            auto it = ids.find(sig);
+            if (it == ids.end()) it = ids.emplace(sig, (int)ids.size()).first;
+            refined[s] = it->second;
+        }
+        bool stable = (int)ids.size() == blockCount;
+        blockCount = ids.size();
+        block = refined;
+        if (stable) break;
+    }
+
+    // 4) renumber so the dead block is state 0 and emit the tables
+    vector<int> order(blockCount, -1);
+    order[block[0]] = DEAD;
+    int counter = 1;
+    for (int s = 0; s < n; ++s) if (order[block[s]] < 0) order[block[s]] = counter++;
+
+    numStates = blockCount;
+    numClasses = classCount;
+    for (int c = 0; c < 256; ++c) byteClass[c] = cls[c];
+    next.assign(numStates * numClasses, DEAD);
+    accept.assign(numStates * 2, -1);
+    for (int s = 0; s < n; ++s) {
+        int b = order[block[s]];
+        for (int k = 0; k < classCount; ++k) next[b * numClasses + k] = order[block[rawNext[s * classCount + k]]];
+        accept[b * 2] = rawAccept[s * 2];
+        accept[b * 2 + 1] = rawAccept[s * 2 + 1];
+    }
+    start = order[block[rawStart]];
+}
@@ -0,0 +1,183 @@
+#include <thread>
+#include <atomic>
+
+using namespace std;
+
+// Pipelined lexing: a lexer thread streams the tokens of one file through a
+// bounded ring to the thread that parses them, so lexing overlaps loading
+// the parse tables and then the parse itself.
+//
+// TokenRing is single producer, single consumer and lock free: each side
+// owns one index and keeps a cached copy of the other side's, re-reading it
+// only when the ring looks full or empty. An index is published with a
+// release store once per PUBLISH_EVERY tokens and before waiting, not per
+// token, so the two cores do not trade its cache line on every token and a
+// waiting side does not take it away from the working one. A full ring
+// makes the lexer wait (backpressure), an empty one the parser; waiting
+// spins briefly, then yields. The lexer closes the ring
+// after its last token, and whatever error stopped it (an indentation
+// error mid-stream, an unreadable file) is in Lexer::error before the close
+// is published, so the parser sees it once the ring runs dry. A parser that
+// stops early cancels the ring and the lexer stops at its next push.
+
+class TokenRing {
+private:
+    vector<Token> slots;
+    size_t mask;
+
+    static const size_t PUBLISH_EVERY = 64;
+
+    // producer side, a cache line of its own
+    alignas(64) atomic<size_t> tail{0};
+    size_t tailLocal = 0;           // tail before it is published
+    size_t headCache = 0;
+    uint64_t pushWaits = 0;
+    atomic<bool> cancelled{false};
+
+    // consumer side
+    alignas(64) atomic<size_t> head{0};
+    size_t headLocal = 0;
+    size_t tailCache = 0;
+    uint64_t popWaits = 0;
+    atomic<bool> closed{false};
+
+    static void backOff(unsigned &spins) {
+        if (++spins > 64) this_thread::yield();
+    }
+
+public:
+    // capacity is rounded up to a power of two, at least PUBLISH_EVERY
+    explicit TokenRing(size_t capacity) {
+        size_t size = PUBLISH_EVERY;
+        while (size < capacity) size <<= 1;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    size_t capacity() const {
+        return slots.size();
+    }
+
+    // pushes that found the ring full, pops that found it empty
+    uint64_t fullWaits() const { return pushWaits; }
+    uint64_t emptyWaits() const { return popWaits; }
+
+    // producer: waits while the ring is full, false once the consumer cancelled
+    bool push(const Token &tok) {
+        size_t t = tailLocal;
+        if (t - headCache == slots.size()) {
+            pushWaits++;
+            tail.store(t, memory_order_release);
+            for (unsigned spins = 0; t - (headCache = head.load(memory_order_acquire)) == slots.size(); backOff(spins)) {
+                if (cancelled.load(memory_order_relaxed)) return false;
+            }
+        }
+        slots[t & mask] = tok;
+        tailLocal = ++t;
+        if (t % PUBLISH_EVERY == 0) tail.store(t, memory_order_release);
+        return true;
+    }
+
+    // producer: no more tokens
+    void close() {
+        tail.store(tailLocal, memory_order_release);
+        closed.store(true, memory_order_release);
+    }
+
+    // consumer: waits while the ring is empty, false once it is empty and closed
+    bool pop(Token &tok) {
+        size_t h = headLocal;
+        if (h == tailCache) {
+            popWaits++;
+            head.store(h, memory_order_release);
+            for (unsigned spins = 0; h == (tailCache = tail.load(memory_order_acquire)); backOff(spins)) {
+                // tokens pushed before the close are visible once it is
+                if (closed.load(memory_order_acquire) && h == (tailCache = tail.load(memory_order_acquire))) {
+                    return false;
+                }
+            }
+        }
+        tok = slots[h & mask];
+        headLocal = ++h;
+        if (h % PUBLISH_EVERY == 0) head.store(h, memory_order_release);
+        return true;
+    }
+
+    // consumer: the producer's pushes fail from now on
+    void cancel() {
+        cancelled.store(true, memory_order_relaxed);
+    }
+};
+
+// The lexer thread of one file and the parser's end of its ring. next()
+// gives BasicLRParser::parseTokens the tokens and feeds them to symbols on
+// the way, so the symbol table needs no pass of its own; finish() gives it
+// the tokens the parser left and waits for the lexer.
+class TokenPipeline {
+private:
+    Lexer &lexer;
+    TokenRing ring;
+    thread producer;
+    bool finished = false;
+
+    void lex() {
+        PhaseScope phase("lex (pipelined)");
+        auto start = chrono::steady_clock::now();
+        try {
+            Token tok;
+            if (lexer.openSource()) {
+                while (lexer.next(tok) && ring.push(tok)) {}
+            }
+        } catch (const exception &e) {
+            lexer.error = string("Lexer thread failed: ") + e.what();
+        }
+        lexSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        ring.close();
+    }
+
+public:
+    SymbolTable symbols;
+    uint64_t tokens = 0;            // taken off the ring
+    double lexSeconds = 0;          // the lexer thread's, valid after finish()
+
+    static constexpr size_t DEFAULT_CAPACITY = 4096;
+
+    // starts lexing lexer's file right away
+    explicit TokenPipeline(Lexer &lexer, size_t capacity = DEFAULT_CAPACITY) : lexer(lexer), ring(capacity) {
+        producer = thread([this] { lex(); });
+    }
+
+    ~TokenPipeline() {
+        ring.cancel();
+        if (producer.joinable()) producer.join();
+    }
+
+    TokenPipeline(const TokenPipeline&) = delete;
+    TokenPipeline& operator=(const TokenPipeline&) = delete;
+
+    bool next(Token &tok) {
+        if (!ring.pop(tok)) return false;
+        symbols.add(tok, lexer);
+        tokens++;
+        return true;
+    }
+
+    // drains the ring into symbols and joins the lexer thread, false when
+    // the lexer failed (Lexer::error says why)
+    bool finish() {
+        if (!finished) {
+            Token tok;
+            while (next(tok)) {}
+            producer.join();
+            symbols.finish();
+            finished = true;
+        }
+        return !lexer.failed();
+    }
+
+    void report(ostream &out) const {
+        out << "pipeline: " << tokens << " tokens through a " << ring.capacity() << " token ring, lexer "
+            << lexSeconds * 1000 << " ms, waited " << ring.fullWaits() << " times on a full ring, parser on an empty one "
+            << ring.emptyWaits() << " times" << endl;
+    }
+};